@@ -6,6 +6,14 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <type_traits>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include "bst.h"
 
 struct KeyError { };
@@ -21,19 +29,21 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    template<typename... Args>
+    AVLNode(AVLNode<Key, Value>* parent, Args&&... args);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
+    // Getters for parent, left, and right. These hide the Node versions since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
@@ -56,6 +66,17 @@ AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Va
 
 }
 
+/**
+* A constructor that builds the item in place, see the Node class.
+*/
+template<class Key, class Value>
+template<typename... Args>
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value> *parent, Args&&... args) :
+    Node<Key, Value>(parent, std::forward<Args>(args)...), balance_(0)
+{
+
+}
+
 /**
 * A destructor which does nothing.
 */
@@ -93,7 +114,7 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
+* Hides Node::getParent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
 */
 template<class Key, class Value>
@@ -103,7 +124,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -112,7 +133,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -128,32 +149,213 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* A self-balancing AVL tree. Alloc must create AVLNodes (or a subclass of
+* AVLNode); by default each tree owns a NodePool of AVLNodes.
+*/
+template <class Key, class Value, class Alloc = NodePool<AVLNode<Key, Value> >, class Stats = NoTreeStats>
+class AVLTree : public BinarySearchTree<Key, Value, Alloc, Stats>
 {
+    static_assert(std::is_base_of<AVLNode<Key, Value>, typename Alloc::node_type>::value,
+                  "AVLTree requires an allocator of AVLNodes");
+
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    AVLTree();
+    template<typename ForwardIt>
+    AVLTree(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
     virtual void remove(const Key& key);  // TODO
+    using BinarySearchTree<Key, Value, Alloc, Stats>::remove;
+
+    // Set operations built on join and split. threads == 0 uses every core.
+    void join(AVLTree& upper);
+    void split(const Key& key, AVLTree& upper);
+    void merge(AVLTree& other, unsigned threads = 0);
+    void intersect(const AVLTree& other, unsigned threads = 0);
+    void difference(const AVLTree& other, unsigned threads = 0);
+    template<typename ForwardIt>
+    void insert_batch(ForwardIt first, ForwardIt last, unsigned threads = 0);
+
 protected:
+    // A detached subtree (root has no parent) and its height.
+    struct Subtree
+    {
+        AVLNode<Key, Value>* root;
+        int height;
+    };
+
+    // Set operations only hand work to another thread for subtrees at
+    // least this tall (a few thousand nodes); below that a thread costs
+    // more than it saves.
+    static const int PARALLEL_HEIGHT = 12;
+    // Batches are sorted and built in chunks of at least this many items.
+    static const std::size_t PARALLEL_CHUNK = 4096;
+
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual void insertRebalance(Node<Key, Value>* node);
+    virtual bool nodeBalanced(Node<Key, Value>* node, int leftHeight, int rightHeight) const;
 
     // Add helper functions here
 		virtual void rotateLeft(AVLNode<Key, Value>* current);
 		virtual void rotateRight(AVLNode<Key, Value>* current);
 		virtual void insertFix(AVLNode<Key, Value>* current, AVLNode<Key, Value>* parent);
 		virtual void removeFix(AVLNode<Key, Value>* current, int8_t diff);
-		AVLNode<Key, Value>* internalFind(const Key& key) const;
+		virtual void removeNode(AVLNode<Key, Value>* current);
+		template<typename K>
+		AVLNode<Key, Value>* internalFind(const K& key) const;
 		AVLNode<Key, Value>* predecessor(AVLNode<Key, Value>* current);
+		template<typename ForwardIt>
+		AVLNode<Key, Value>* buildSorted(ForwardIt& it, std::size_t n, int& height);
+		virtual void restructured(AVLNode<Key, Value>* root);
+		virtual void linked(AVLNode<Key, Value>* middle);
+		virtual void settled(AVLNode<Key, Value>* root);
+		virtual std::size_t countLower(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper, std::size_t total) const;
+
+		static int heightOf(AVLNode<Key, Value>* root);
+		Subtree detach();
+		void attach(Subtree tree);
+		static void unlinkChildren(Subtree tree, Subtree& left, Subtree& right);
+		Subtree joinTrees(Subtree left, AVLNode<Key, Value>* middle, Subtree right);
+		Subtree joinTrees(Subtree left, Subtree right);
+		bool joinFix(AVLNode<Key, Value>* grown, AVLNode<Key, Value>*& top);
+		Subtree splitLast(Subtree tree, AVLNode<Key, Value>*& last);
+		void splitTree(Subtree tree, const Key& key, Subtree& less, AVLNode<Key, Value>*& match, Subtree& greater);
+		Subtree unionTrees(Subtree a, Subtree b, unsigned forks, std::vector<AVLNode<Key, Value>*>& dropped);
+		Subtree intersectTrees(Subtree a, const AVLNode<Key, Value>* b, unsigned forks, std::vector<AVLNode<Key, Value>*>& dropped);
+		Subtree differenceTrees(Subtree a, const AVLNode<Key, Value>* b, unsigned forks, std::vector<AVLNode<Key, Value>*>& dropped);
+		void mergeSubtree(Subtree theirs, unsigned threads);
+		template<typename LeftTask, typename RightTask>
+		static void forkJoin(LeftTask leftTask, RightTask rightTask, unsigned forks, int height,
+		                     Subtree& left, Subtree& right, std::vector<AVLNode<Key, Value>*>& dropped);
+		void destroyDropped(const std::vector<AVLNode<Key, Value>*>& dropped);
+		static unsigned threadCount(unsigned threads);
+		static unsigned forkCount(unsigned threads);
+		template<typename RandomIt, typename Compare>
+		static void sortBatch(RandomIt first, RandomIt last, Compare less, unsigned threads);
 };
 
+/**
+* Default constructor for an empty AVLTree.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+AVLTree<Key, Value, Alloc, Stats>::AVLTree() :
+    BinarySearchTree<Key, Value, Alloc, Stats>()
+{
+
+}
+
+/**
+* Constructs the tree from the key/value pairs in [first, last).
+* See assign().
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename ForwardIt>
+AVLTree<Key, Value, Alloc, Stats>::AVLTree(ForwardIt first, ForwardIt last) :
+    BinarySearchTree<Key, Value, Alloc, Stats>()
+{
+    assign(first, last);
+}
+
+/**
+* Replaces the contents of the tree with the key/value pairs in [first, last).
+* If the keys are strictly increasing the tree is built bottom-up in O(n)
+* with no searching or rotations, producing a perfectly balanced tree.
+* Otherwise falls back to inserting each pair, where later duplicates
+* overwrite earlier ones. If copying a pair throws, the sorted build
+* leaves the tree empty; the insert fallback keeps the pairs before it.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc, Stats>::assign(ForwardIt first, ForwardIt last)
+{
+    this->clear();
+    if(first == last) {
+        return;
+    }
+
+    bool sorted = true;
+    std::size_t n = 1;
+    ForwardIt prev = first;
+    for(ForwardIt it = std::next(first); it != last; ++it, ++prev, ++n) {
+        if(sorted && !(prev->first < it->first)) {
+            sorted = false;
+        }
+    }
+
+    if(!sorted) {
+        for(ForwardIt it = first; it != last; ++it) {
+            this->insert(*it);
+        }
+        return;
+    }
+
+    int height;
+    AVLNode<Key, Value>* root = buildSorted(first, n, height);
+    this->root_ = root;
+    restructured(root);
+}
+
+/**
+* Builds a balanced subtree from the next n pairs of a sorted sequence,
+* advancing it past them, and reports the subtree's height. The right
+* half is never smaller than the left, so every balance is 0 or +1.
+* If building an item throws, every node built so far is destroyed.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename ForwardIt>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc, Stats>::buildSorted(ForwardIt& it, std::size_t n, int& height)
+{
+    if(n == 0) {
+        height = 0;
+        return nullptr;
+    }
+
+    std::size_t leftCount = (n - 1) / 2;
+    int leftHeight, rightHeight;
+
+    AVLNode<Key, Value>* left = buildSorted(it, leftCount, leftHeight);
+    AVLNode<Key, Value>* current = nullptr;
+    AVLNode<Key, Value>* right;
+    try {
+        current = this->createNode(nullptr, it->first, it->second);
+        ++it;
+        right = buildSorted(it, n - 1 - leftCount, rightHeight);
+    }
+    catch(...) {
+        //The right half freed what it had built; free this level's part
+        this->destroySubtree(left);
+        if(current != nullptr) {
+            this->destroyNode(current);
+        }
+        throw;
+    }
+
+    current->setLeft(left);
+    current->setRight(right);
+    if(left != nullptr) {
+        left->setParent(current);
+    }
+    if(right != nullptr) {
+        right->setParent(current);
+    }
+    current->setBalance(static_cast<int8_t>(rightHeight - leftHeight));
+
+    height = 1 + std::max(leftHeight, rightHeight);
+    return current;
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* current) {
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::rotateLeft(AVLNode<Key, Value>* current) {
+	this->stats_.rotatedLeft();
 	AVLNode<Key, Value>* temp = (current->getRight());
 	AVLNode<Key, Value>* tempChild = (temp->getLeft());
 
@@ -177,7 +379,9 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* current) {
 	}
 
 	else if(current->getParent() == nullptr) { //If current's parent is nullptr, set temp as new root
-		this->root_ = temp;
+		if(this->root_ == current) { //Unless current tops a detached subtree, see joinTrees()
+			this->root_ = temp;
+		}
 		temp->setParent(nullptr);
 		temp->setLeft(current);
 		current->setRight(tempChild);
@@ -189,8 +393,9 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* current) {
 	}
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* current) {
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::rotateRight(AVLNode<Key, Value>* current) {
+	this->stats_.rotatedRight();
 	AVLNode<Key, Value>* temp = (current->getLeft());
 	AVLNode<Key, Value>* tempChild = (temp->getRight());
 
@@ -214,7 +419,9 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* current) {
 	}
 
 	else if(current->getParent() == nullptr) { //If current's parent is nullptr, set temp as new root
-		this->root_ = temp;
+		if(this->root_ == current) { //Unless current tops a detached subtree, see joinTrees()
+			this->root_ = temp;
+		}
 		temp->setParent(nullptr);
 		temp->setRight(current);
 		current->setLeft(tempChild);
@@ -228,183 +435,144 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* current) {
 
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* current, AVLNode<Key, Value>* parent)
+/**
+* Walks up from a parent whose balance just became -1/+1, propagating the
+* height increase until it is absorbed (a balance returns to 0) or fixed by
+* a rotation, after which the height above is unchanged and we stop.
+* Iterative, so no stack is used however tall the tree.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::insertFix(AVLNode<Key, Value>* current, AVLNode<Key, Value>* parent)
 {
-	if((parent == nullptr) || (parent->getParent() == nullptr)) {
-		return;
-	}
-
-	AVLNode<Key, Value>* grandParent = parent->getParent();
-
-	if(grandParent->getLeft() == parent) { //Current node is left node of parent
-		grandParent->updateBalance(-1);
-		if(grandParent->getBalance() == 0) {
+	while(parent != nullptr) {
+		this->stats_.insertFixLevel();
+		AVLNode<Key, Value>* grandParent = parent->getParent();
+		if(grandParent == nullptr) {
 			return;
 		}
 
-		else if(grandParent->getBalance() == -1) {
-			insertFix(parent, grandParent);
-		}
+		if(grandParent->getLeft() == parent) { //Parent is left node of grandparent
+			grandParent->updateBalance(-1);
+			if(grandParent->getBalance() == 0) { //Height change absorbed
+				return;
+			}
+
+			else if(grandParent->getBalance() == -1) { //Grandparent grew too, keep climbing
+				current = parent;
+				parent = grandParent;
+				continue;
+			}
 
-		else if(grandParent->getBalance() == -2) {
-			if(parent->getBalance() == -1) {
+			//Balance is -2
+			if(parent->getBalance() == -1) { //Zig-zig
 				rotateRight(grandParent);
 				parent->setBalance(0);
 				grandParent->setBalance(0);
 			}
 
-			else if(parent->getBalance() == 1) {
+			else { //Zig-zag
 				rotateLeft(parent);
 				rotateRight(grandParent);
 
 				if(current->getBalance() == -1) {
 					parent->setBalance(0);
 					grandParent->setBalance(1);
-					current->setBalance(0);
 				}
 				else if(current->getBalance() == 0) {
 					parent->setBalance(0);
 					grandParent->setBalance(0);
-					current->setBalance(0);
 				}
-				else if(current->getBalance() == 1) {
+				else {
 					parent->setBalance(-1);
 					grandParent->setBalance(0);
-					current->setBalance(0);
 				}
+				current->setBalance(0);
 			}
-		}
-	}
-	
-	else if(grandParent->getRight() == parent) { //Current node is right node of parent
-		grandParent->updateBalance(1);
-		if(grandParent->getBalance() == 0) {
 			return;
 		}
 
-		else if(grandParent->getBalance() == 1) {
-			insertFix(parent, grandParent);
-		}
+		else { //Parent is right node of grandparent
+			grandParent->updateBalance(1);
+			if(grandParent->getBalance() == 0) { //Height change absorbed
+				return;
+			}
 
-		else if(grandParent->getBalance() == 2) {
-			if(parent->getBalance() == 1) {
+			else if(grandParent->getBalance() == 1) { //Grandparent grew too, keep climbing
+				current = parent;
+				parent = grandParent;
+				continue;
+			}
+
+			//Balance is 2
+			if(parent->getBalance() == 1) { //Zig-zig
 				rotateLeft(grandParent);
 				parent->setBalance(0);
 				grandParent->setBalance(0);
 			}
 
-			else if(parent->getBalance() == -1) {
+			else { //Zig-zag
 				rotateRight(parent);
 				rotateLeft(grandParent);
 
 				if(current->getBalance() == 1) {
 					parent->setBalance(0);
 					grandParent->setBalance(-1);
-					current->setBalance(0);
 				}
 				else if(current->getBalance() == 0) {
 					parent->setBalance(0);
 					grandParent->setBalance(0);
-					current->setBalance(0);
 				}
-				else if(current->getBalance() == -1) {
+				else {
 					parent->setBalance(1);
 					grandParent->setBalance(0);
-					current->setBalance(0);
 				}
+				current->setBalance(0);
 			}
+			return;
 		}
 	}
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+/**
+* Per-node test used by isBalanced(). Besides the heights differing by at
+* most one, the stored balance must match them, so a bad rebalance shows
+* up at the node it corrupted rather than only once heights drift apart.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+bool AVLTree<Key, Value, Alloc, Stats>::nodeBalanced(Node<Key, Value>* node, int leftHeight, int rightHeight) const
 {
-  // TODO
-	if(this->root_ == nullptr) {
-		Node<Key, Value>* newRoot = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
-		this->root_ = newRoot;
-		return;
-	}
+	int balance = static_cast<AVLNode<Key, Value>*>(node)->getBalance();
+	return balance == rightHeight - leftHeight && balance >= -1 && balance <= 1;
+}
+
+/**
+* Inserting is handled by BinarySearchTree::insert; this fixes up the
+* balances once the new leaf has been linked in.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::insertRebalance(Node<Key, Value>* node)
+{
+	AVLNode<Key, Value>* newNode = static_cast<AVLNode<Key, Value>*>(node);
+	AVLNode<Key, Value>* parent = newNode->getParent();
 
-	AVLNode<Key, Value>* nodeFind = internalFind(new_item.first); //First, check to see if node already exists
-	if(nodeFind != nullptr) {
-		nodeFind->setValue(new_item.second);
+	if(parent == nullptr) { //New root, nothing to fix
 		return;
 	}
 
-	else {
-		delete nodeFind;
-		AVLNode<Key, Value>* current = static_cast<AVLNode<Key, Value>*>(this->root_);
-		AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(this->root_); //Keep track of parent in case itr becomes null
-
-		if(new_item.first < current->getKey()) { //Check if the key is smaller than current's key
-			if(current->getLeft() != nullptr) { //If root_ contains a left child, search through left subtree
-				current = current->getLeft();
-			}
-			
-			while(current != nullptr) { //Search through the subtree until current becomes nullptr
-				if(new_item.first < current->getKey()) { //If key is smaller than current, continue searching through left subtree
-					parent = current;
-					current = current->getLeft();
-				}
-				else if(new_item.first > current->getKey()) { //If key is greater than current, continue searching through right subtree
-					parent = current;
-					current = current->getRight();
-				}
-			}
-		}
+	//Set balances
 
-		else if(new_item.first > current->getKey()) { //Check if the key is greater than current's key
-			if(current->getRight() != nullptr) { //If root_ contains a left child, search through left subtree
-				current = current->getRight();
-			}
-
-			while(current != nullptr) { //Search through the subtree until current becomes nullptr
-				if(new_item.first < current->getKey()) { //If key is smaller than current, continue searching through left subtree
-					parent = current;
-					current = current->getLeft();
-				}
-
-				else if(new_item.first > current->getKey()) { //If key is greater than current, continue searching through right subtree
-					parent = current;
-					current = current->getRight();
-				}
-			}
-		}
-
-		//Create new node based on parent's location
-
-		AVLNode<Key, Value>* newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
-		if(new_item.first < parent->getKey()) { //If key is less than parent make it a left node
-			parent->setLeft(newNode);
-			newNode->setBalance(0);
-		}
-		else if(new_item.first > parent->getKey()) { //If key is greater than parent make it a right node
-			parent->setRight(newNode); 
-			newNode->setBalance(0);
-		}
-
-		//Set balances
-
-		if(parent->getBalance() == -1) {
-			parent->setBalance(0);
-		}
+	if(parent->getBalance() != 0) { //Parent was leaning, the new leaf evens it out
+		parent->setBalance(0);
+	}
 
-		else if(parent->getBalance() == 1) {
-			parent->setBalance(0);
+	else {
+		if(parent->getRight() == newNode) {
+			parent->setBalance(1);
 		}
-
-		else if(parent->getBalance() == 0) {
-			if(parent->getRight() == newNode) {
-				parent->setBalance(1);
-			}
-			else if(parent->getLeft() == newNode) {
-				parent->setBalance(-1);
-			}
-			insertFix(newNode, parent);
+		else if(parent->getLeft() == newNode) {
+			parent->setBalance(-1);
 		}
+		insertFix(newNode, parent);
 	}
 }
 
@@ -413,123 +581,108 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
  * should swap with the predecessor and then remove.
  */
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* current, int8_t diff) //Look at balance later
+/**
+* Applies diff (+1 if current lost height on its left, -1 on its right) and
+* walks up while the subtree height keeps shrinking. Stops as soon as a
+* node absorbs the change (balance becomes -1/+1, or a rotation around a
+* child with balance 0 keeps the height). Iterative, so no stack is used.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::removeFix(AVLNode<Key, Value>* current, int8_t diff)
 {
-	if(current == nullptr) { //If current doesn't exist, return
-		return;
-	}
-
-	AVLNode<Key, Value>* parent = current->getParent(); //Keep track of current's parent for next recursive call
-	int8_t ndiff; //Keep track of ndiff for next recursive call
+	while(current != nullptr) {
+		this->stats_.removeFixLevel();
+		AVLNode<Key, Value>* parent = current->getParent(); //Keep track of current's parent for the next level
+		int8_t ndiff = 0; //And which side of it we are on
 
-	if(parent != nullptr) {
-		if(parent->getLeft() == current) { //Current is left child
-			ndiff = 1;
+		if(parent != nullptr) {
+			ndiff = (parent->getLeft() == current) ? 1 : -1;
 		}
-		else if(parent->getRight() == current) { //Current is left child
-			ndiff = -1;
-		}
-	}
 
-	if(current->getBalance() + diff == -2) {
-		AVLNode<Key, Value>* child = current->getLeft();
-		if(child->getBalance() == -1) {
-			rotateRight(current); //Zig-zig
-			current->setBalance(0);
-			child->setBalance(0);
-			removeFix(parent, ndiff);
-		}
-		else if(child->getBalance() == 0) {
-			rotateRight(current); //Zig-zig
-			current->setBalance(-1);
-			child->setBalance(1);
-			return; //Done!
-		}
-		else if(child->getBalance() == 1) {
-			AVLNode<Key, Value>* grandchild = child->getRight();
-			rotateLeft(child);
-			rotateRight(current); //Zig-zag
-			if(grandchild->getBalance() == 1) {
-				current->setBalance(0);
-				child->setBalance(-1);
-				grandchild->setBalance(0);
-			}
+		int balance = current->getBalance() + diff;
 
-			else if(grandchild->getBalance() == 0) {
+		if(balance == -2) {
+			AVLNode<Key, Value>* child = current->getLeft();
+			if(child->getBalance() == 0) {
+				rotateRight(current); //Zig-zig, height unchanged
+				current->setBalance(-1);
+				child->setBalance(1);
+				return; //Done!
+			}
+			else if(child->getBalance() == -1) {
+				rotateRight(current); //Zig-zig
 				current->setBalance(0);
 				child->setBalance(0);
-				grandchild->setBalance(0);
 			}
-
-			else if(grandchild->getBalance() == -1) {
-				current->setBalance(1);
-				child->setBalance(0);
+			else {
+				AVLNode<Key, Value>* grandchild = child->getRight();
+				rotateLeft(child);
+				rotateRight(current); //Zig-zag
+				if(grandchild->getBalance() == 1) {
+					current->setBalance(0);
+					child->setBalance(-1);
+				}
+				else if(grandchild->getBalance() == 0) {
+					current->setBalance(0);
+					child->setBalance(0);
+				}
+				else {
+					current->setBalance(1);
+					child->setBalance(0);
+				}
 				grandchild->setBalance(0);
 			}
-
-			removeFix(parent, ndiff);
 		}
-	}
-
-	else if(current->getBalance() + diff == -1) {
-		current->setBalance(-1);
-		return;
-	}
 
-	else if(current->getBalance() + diff == 0) {
-		current->setBalance(0);
-		removeFix(parent, ndiff);
-	}
-
-	else if(current->getBalance() + diff == 2) {
-		AVLNode<Key, Value>* child = current->getRight();
-		if(child->getBalance() == 1) {
-			rotateLeft(current); //Zig-zig
-			current->setBalance(0);
-			child->setBalance(0);
-			removeFix(parent, ndiff);
-		}
-		else if(child->getBalance() == 0) {
-			rotateLeft(current); //Zig-zig
-			current->setBalance(1);
-			child->setBalance(-1);
-		}
-		else if(child->getBalance() == -1) {
-			AVLNode<Key, Value>* grandchild = child->getLeft();
-			rotateRight(child);
-			rotateLeft(current); //Zig-zag
-			if(grandchild->getBalance() == -1) {
-				current->setBalance(0);
-				child->setBalance(1);
-				grandchild->setBalance(0);
+		else if(balance == 2) {
+			AVLNode<Key, Value>* child = current->getRight();
+			if(child->getBalance() == 0) {
+				rotateLeft(current); //Zig-zig, height unchanged
+				current->setBalance(1);
+				child->setBalance(-1);
+				return; //Done!
 			}
-
-			else if(grandchild->getBalance() == 0) {
+			else if(child->getBalance() == 1) {
+				rotateLeft(current); //Zig-zig
 				current->setBalance(0);
 				child->setBalance(0);
-				grandchild->setBalance(0);
 			}
-
-			else if(grandchild->getBalance() == 1) {
-				current->setBalance(-1);
-				child->setBalance(0);
+			else {
+				AVLNode<Key, Value>* grandchild = child->getLeft();
+				rotateRight(child);
+				rotateLeft(current); //Zig-zag
+				if(grandchild->getBalance() == -1) {
+					current->setBalance(0);
+					child->setBalance(1);
+				}
+				else if(grandchild->getBalance() == 0) {
+					current->setBalance(0);
+					child->setBalance(0);
+				}
+				else {
+					current->setBalance(-1);
+					child->setBalance(0);
+				}
 				grandchild->setBalance(0);
 			}
+		}
 
-			removeFix(parent, ndiff);
+		else if(balance != 0) { //-1 or 1: the subtree kept its height
+			current->setBalance(static_cast<int8_t>(balance));
+			return;
 		}
-	}
 
-	else if(current->getBalance() + diff == 1) {
-		current->setBalance(1);
-		return;
-	}
+		else { //0: the subtree got shorter
+			current->setBalance(0);
+		}
 
+		current = parent;
+		diff = ndiff;
+	}
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>:: remove(const Key& key)
 {
   // TODO
 	AVLNode<Key, Value>* current = internalFind(key); //Find node to remove
@@ -538,6 +691,25 @@ void AVLTree<Key, Value>:: remove(const Key& key)
 		return;
 	}
 
+	removeNode(current);
+}
+
+/**
+* What the transparent remove() of BinarySearchTree calls once it has
+* found the node.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::eraseNode(Node<Key, Value>* node)
+{
+	removeNode(static_cast<AVLNode<Key, Value>*>(node));
+}
+
+/**
+* Unlinks and frees a node of this tree, then rebalances.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::removeNode(AVLNode<Key, Value>* current)
+{
 	if(current->getRight() != nullptr && current->getLeft() != nullptr) { //If node has two children, then swap with predecessor
 		AVLNode<Key, Value>* predecessorNode = predecessor(current);
 		nodeSwap(current, predecessorNode);
@@ -585,32 +757,846 @@ void AVLTree<Key, Value>:: remove(const Key& key)
 		}
 	}
 
-	delete current;
+	this->destroyNode(current);
 	removeFix(parent, diff);
 	
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::predecessor(AVLNode<Key, Value>* current)
+template<class Key, class Value, class Alloc, class Stats>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc, Stats>::predecessor(AVLNode<Key, Value>* current)
 {   
-	AVLNode<Key, Value>* itr = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::predecessor(current));
+	AVLNode<Key, Value>* itr = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value, Alloc, Stats>::predecessor(current));
 	return itr;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Alloc, Stats>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
 }
 
-template<typename Key, typename Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Alloc, typename Stats>
+template<typename K>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc, Stats>::internalFind(const K& key) const
 {
-	AVLNode<Key, Value>* itr = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value>::internalFind(key));
+	AVLNode<Key, Value>* itr = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key, Value, Alloc, Stats>::internalFind(key));
 	return itr;
 }
 
+/*
+ * Hooks for trees that keep more per node than the balance, which the
+ * operations below maintain themselves. An AVLTree has nothing more, so
+ * they do nothing here.
+ */
+
+/**
+* Called after a sorted bulk load built the (detached, or whole) subtree
+* at root without going through the insert hooks. Derived trees rebuild
+* what they keep for its nodes, in O(size of the subtree).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::restructured(AVLNode<Key, Value>* root)
+{
+
+}
+
+/**
+* Called by joinTrees() once middle has its two children and has been
+* hung in place, before the rebalancing rotations. Everything below
+* middle is up to date; middle and the nodes above it up to the top of
+* the detached subtree are not. May run on several threads at once, on
+* disjoint subtrees.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::linked(AVLNode<Key, Value>* middle)
+{
+
+}
+
+/**
+* Called when a join, split or set operation has made root the root of
+* a whole tree again.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::settled(AVLNode<Key, Value>* root)
+{
+
+}
+
+/**
+* Given the roots of the two trees a split left, with total nodes between
+* them, returns how many are under lower. Both trees are walked in order
+* in step until one runs out, so this costs O(log n) plus the smaller
+* count; derived trees that know their subtree sizes answer at once.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+std::size_t AVLTree<Key, Value, Alloc, Stats>::countLower(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper,
+                                                     std::size_t total) const
+{
+	Node<Key, Value>* lowerItr = lower;
+	Node<Key, Value>* upperItr = upper;
+	while(lowerItr != nullptr && lowerItr->getLeft() != nullptr) {
+		lowerItr = lowerItr->getLeft();
+	}
+	while(upperItr != nullptr && upperItr->getLeft() != nullptr) {
+		upperItr = upperItr->getLeft();
+	}
+
+	std::size_t steps = 0;
+	while(lowerItr != nullptr && upperItr != nullptr) {
+		lowerItr = this->successor(lowerItr);
+		upperItr = this->successor(upperItr);
+		++steps;
+	}
+	return (lowerItr == nullptr) ? steps : total - steps;
+}
+
+/*
+ * Set operations.
+ *
+ * Everything below works on detached subtrees and is built from two
+ * primitives, as in Blelloch, Ferizovic and Sun, "Just Join for Parallel
+ * Ordered Sets":
+ *
+ *   joinTrees(L, k, R)  all keys in L < k < all keys in R; O(|h(L) - h(R)|)
+ *   splitTree(T, key)   the keys of T below key, the node with key (if
+ *                       any) and the keys above it; O(log n)
+ *
+ * Heights are not stored, only balances, so they are passed along with
+ * each subtree and derived for children from the parent's balance; only
+ * the public entry points pay O(log n) to measure a whole tree. Union,
+ * intersection and difference then take O(m log(n/m + 1)) for trees of
+ * sizes m <= n, and their two recursive calls touch disjoint subtrees,
+ * so they can run on different threads (see forkJoin()).
+ *
+ * Derived trees that keep more per node keep it right through linked(),
+ * which joinTrees() calls at the one place it hangs a node, and
+ * settled(), called once on each finished tree. Neither walks the whole
+ * tree.
+ */
+
+/**
+* Follows the taller child down to a leaf.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+int AVLTree<Key, Value, Alloc, Stats>::heightOf(AVLNode<Key, Value>* root)
+{
+	int height = 0;
+	while(root != nullptr) {
+		++height;
+		root = (root->getBalance() > 0) ? root->getRight() : root->getLeft();
+	}
+	return height;
+}
+
+/**
+* Takes the whole tree out of this object, leaving root_ NULL until
+* attach(). Rotations leave root_ alone when they rotate the top of a
+* detached subtree, so the set operations below may run on disjoint
+* subtrees from several threads.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree AVLTree<Key, Value, Alloc, Stats>::detach()
+{
+	AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+	Subtree tree = { root, heightOf(root) };
+	this->root_ = nullptr;
+	return tree;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::attach(Subtree tree)
+{
+	this->root_ = tree.root;
+	if(tree.root != nullptr) {
+		tree.root->setParent(nullptr);
+	}
+}
+
+/**
+* Detaches both children of tree's root and reports them with their
+* heights. The root is left with no links.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::unlinkChildren(Subtree tree, Subtree& left, Subtree& right)
+{
+	AVLNode<Key, Value>* root = tree.root;
+	left.root = root->getLeft();
+	left.height = tree.height - 1 - (root->getBalance() > 0 ? 1 : 0);
+	right.root = root->getRight();
+	right.height = tree.height - 1 - (root->getBalance() < 0 ? 1 : 0);
+
+	if(left.root != nullptr) {
+		left.root->setParent(nullptr);
+	}
+	if(right.root != nullptr) {
+		right.root->setParent(nullptr);
+	}
+	root->setLeft(nullptr);
+	root->setRight(nullptr);
+}
+
+/**
+* Joins left, middle and right into one AVL tree. If one side is more
+* than one level taller, middle is hung from that side's inner spine at
+* the first node no taller than the other side plus one, and the spine is
+* rebalanced from there up as after an insertion.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::joinTrees(Subtree left, AVLNode<Key, Value>* middle, Subtree right)
+{
+	middle->setParent(nullptr);
+
+	if(left.height > right.height + 1) { //Walk down left's right spine
+		AVLNode<Key, Value>* parent = nullptr;
+		AVLNode<Key, Value>* spine = left.root;
+		int height = left.height;
+		while(height > right.height + 1) {
+			height -= (spine->getBalance() < 0) ? 2 : 1;
+			parent = spine;
+			spine = spine->getRight();
+		}
+
+		middle->setLeft(spine);
+		middle->setRight(right.root);
+		if(spine != nullptr) {
+			spine->setParent(middle);
+		}
+		if(right.root != nullptr) {
+			right.root->setParent(middle);
+		}
+		middle->setBalance(static_cast<int8_t>(right.height - height));
+		parent->setRight(middle);
+		middle->setParent(parent);
+		linked(middle);
+
+		AVLNode<Key, Value>* top = left.root;
+		bool grew = joinFix(middle, top);
+		Subtree joined = { top, left.height + (grew ? 1 : 0) };
+		return joined;
+	}
+
+	if(right.height > left.height + 1) { //Mirror image: walk down right's left spine
+		AVLNode<Key, Value>* parent = nullptr;
+		AVLNode<Key, Value>* spine = right.root;
+		int height = right.height;
+		while(height > left.height + 1) {
+			height -= (spine->getBalance() > 0) ? 2 : 1;
+			parent = spine;
+			spine = spine->getLeft();
+		}
+
+		middle->setLeft(left.root);
+		middle->setRight(spine);
+		if(left.root != nullptr) {
+			left.root->setParent(middle);
+		}
+		if(spine != nullptr) {
+			spine->setParent(middle);
+		}
+		middle->setBalance(static_cast<int8_t>(height - left.height));
+		parent->setLeft(middle);
+		middle->setParent(parent);
+		linked(middle);
+
+		AVLNode<Key, Value>* top = right.root;
+		bool grew = joinFix(middle, top);
+		Subtree joined = { top, right.height + (grew ? 1 : 0) };
+		return joined;
+	}
+
+	//Heights within one: middle becomes the root
+	middle->setLeft(left.root);
+	middle->setRight(right.root);
+	if(left.root != nullptr) {
+		left.root->setParent(middle);
+	}
+	if(right.root != nullptr) {
+		right.root->setParent(middle);
+	}
+	middle->setBalance(static_cast<int8_t>(right.height - left.height));
+	linked(middle);
+	Subtree joined = { middle, 1 + std::max(left.height, right.height) };
+	return joined;
+}
+
+/**
+* Joins two trees with no middle key by taking the largest node of left
+* as the middle.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::joinTrees(Subtree left, Subtree right)
+{
+	if(left.root == nullptr) {
+		return right;
+	}
+	if(right.root == nullptr) {
+		return left;
+	}
+	AVLNode<Key, Value>* last;
+	Subtree rest = splitLast(left, last);
+	return joinTrees(rest, last, right);
+}
+
+/**
+* The subtree rooted at grown got one level taller. Fixes balances from
+* its parent up to top, rotating where needed, exactly like insertFix but
+* stopping at top (the root of a detached subtree) and updating top if a
+* rotation replaces it. Returns true if top's height grew.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+bool AVLTree<Key, Value, Alloc, Stats>::joinFix(AVLNode<Key, Value>* grown, AVLNode<Key, Value>*& top)
+{
+	while(grown != top) {
+		AVLNode<Key, Value>* parent = grown->getParent();
+		bool isRight = (parent->getRight() == grown);
+		int balance = parent->getBalance() + (isRight ? 1 : -1);
+
+		if(balance == 0) { //Height change absorbed
+			parent->setBalance(0);
+			return false;
+		}
+		if(balance == 1 || balance == -1) { //Parent grew too, keep climbing
+			parent->setBalance(static_cast<int8_t>(balance));
+			grown = parent;
+			continue;
+		}
+
+		bool wasTop = (parent == top);
+		AVLNode<Key, Value>* newTop;
+		bool stillGrown;
+		int8_t side = isRight ? 1 : -1;
+
+		if(grown->getBalance() != -side) { //Zig-zig (or an even child)
+			if(isRight) {
+				rotateLeft(parent);
+			}
+			else {
+				rotateRight(parent);
+			}
+			if(grown->getBalance() == side) {
+				parent->setBalance(0);
+				grown->setBalance(0);
+				stillGrown = false;
+			}
+			else {
+				parent->setBalance(side);
+				grown->setBalance(static_cast<int8_t>(-side));
+				stillGrown = true;
+			}
+			newTop = grown;
+		}
+		else { //Zig-zag
+			AVLNode<Key, Value>* grandchild = isRight ? grown->getLeft() : grown->getRight();
+			if(isRight) {
+				rotateRight(grown);
+				rotateLeft(parent);
+			}
+			else {
+				rotateLeft(grown);
+				rotateRight(parent);
+			}
+			if(grandchild->getBalance() == side) {
+				parent->setBalance(static_cast<int8_t>(-side));
+				grown->setBalance(0);
+			}
+			else if(grandchild->getBalance() == 0) {
+				parent->setBalance(0);
+				grown->setBalance(0);
+			}
+			else {
+				parent->setBalance(0);
+				grown->setBalance(side);
+			}
+			grandchild->setBalance(0);
+			newTop = grandchild;
+			stillGrown = false;
+		}
+
+		if(wasTop) {
+			top = newTop;
+		}
+		if(!stillGrown) {
+			return false;
+		}
+		grown = newTop;
+	}
+	return true;
+}
+
+/**
+* Removes the largest node from tree, returning it through last (with no
+* links) and the rest of the tree as the result. O(log n).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::splitLast(Subtree tree, AVLNode<Key, Value>*& last)
+{
+	AVLNode<Key, Value>* root = tree.root;
+	Subtree left, right;
+	unlinkChildren(tree, left, right);
+	if(right.root == nullptr) {
+		last = root;
+		return left;
+	}
+	Subtree rest = splitLast(right, last);
+	return joinTrees(left, root, rest);
+}
+
+/**
+* Splits tree into the keys less than key and the keys greater than key.
+* The node holding key, if there is one, is returned through match with
+* no links; otherwise match is NULL.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::splitTree(Subtree tree, const Key& key, Subtree& less,
+                                           AVLNode<Key, Value>*& match, Subtree& greater)
+{
+	if(tree.root == nullptr) {
+		less = tree;
+		greater = tree;
+		match = nullptr;
+		return;
+	}
+
+	AVLNode<Key, Value>* root = tree.root;
+	Subtree left, right;
+	unlinkChildren(tree, left, right);
+
+	if(key < root->getKey()) {
+		Subtree between;
+		splitTree(left, key, less, match, between);
+		greater = joinTrees(between, root, right);
+	}
+	else if(root->getKey() < key) {
+		Subtree between;
+		splitTree(right, key, between, match, greater);
+		less = joinTrees(left, root, between);
+	}
+	else {
+		less = left;
+		match = root;
+		greater = right;
+	}
+}
+
+/**
+* Union of two detached subtrees whose nodes both belong to this tree's
+* allocator. Where both have a key, b's node is kept and a's is added to
+* dropped, to be destroyed by the caller once no other thread is running
+* (the allocator is not thread-safe). forks is how many more threads this
+* call may start.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::unionTrees(Subtree a, Subtree b, unsigned forks,
+                                       std::vector<AVLNode<Key, Value>*>& dropped)
+{
+	if(a.root == nullptr) {
+		return b;
+	}
+	if(b.root == nullptr) {
+		return a;
+	}
+
+	AVLNode<Key, Value>* root = b.root;
+	Subtree bLeft, bRight;
+	unlinkChildren(b, bLeft, bRight);
+
+	Subtree less, greater;
+	AVLNode<Key, Value>* match;
+	splitTree(a, root->getKey(), less, match, greater);
+	if(match != nullptr) {
+		dropped.push_back(match);
+	}
+
+	Subtree left, right;
+	forkJoin([this, less, bLeft](unsigned leftForks, std::vector<AVLNode<Key, Value>*>& leftDropped) {
+	             return unionTrees(less, bLeft, leftForks, leftDropped);
+	         },
+	         [this, greater, bRight](unsigned rightForks, std::vector<AVLNode<Key, Value>*>& rightDropped) {
+	             return unionTrees(greater, bRight, rightForks, rightDropped);
+	         },
+	         forks, std::min(a.height, b.height), left, right, dropped);
+	return joinTrees(left, root, right);
+}
+
+/**
+* Keeps the nodes of a whose keys are also in the (untouched) subtree
+* rooted at b, and adds the subtrees holding the rest to dropped. See
+* unionTrees().
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::intersectTrees(Subtree a, const AVLNode<Key, Value>* b, unsigned forks,
+                                           std::vector<AVLNode<Key, Value>*>& dropped)
+{
+	if(a.root == nullptr) {
+		return a;
+	}
+	if(b == nullptr) {
+		dropped.push_back(a.root);
+		Subtree empty = { nullptr, 0 };
+		return empty;
+	}
+
+	Subtree less, greater;
+	AVLNode<Key, Value>* match;
+	splitTree(a, b->getKey(), less, match, greater);
+
+	Subtree left, right;
+	forkJoin([this, less, b](unsigned leftForks, std::vector<AVLNode<Key, Value>*>& leftDropped) {
+	             return intersectTrees(less, b->getLeft(), leftForks, leftDropped);
+	         },
+	         [this, greater, b](unsigned rightForks, std::vector<AVLNode<Key, Value>*>& rightDropped) {
+	             return intersectTrees(greater, b->getRight(), rightForks, rightDropped);
+	         },
+	         forks, a.height, left, right, dropped);
+	if(match != nullptr) {
+		return joinTrees(left, match, right);
+	}
+	return joinTrees(left, right);
+}
+
+/**
+* Adds the nodes of a whose keys are in the (untouched) subtree rooted
+* at b to dropped, and keeps the rest. See unionTrees().
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename AVLTree<Key, Value, Alloc, Stats>::Subtree
+AVLTree<Key, Value, Alloc, Stats>::differenceTrees(Subtree a, const AVLNode<Key, Value>* b, unsigned forks,
+                                            std::vector<AVLNode<Key, Value>*>& dropped)
+{
+	if(a.root == nullptr || b == nullptr) {
+		return a;
+	}
+
+	Subtree less, greater;
+	AVLNode<Key, Value>* match;
+	splitTree(a, b->getKey(), less, match, greater);
+	if(match != nullptr) {
+		dropped.push_back(match);
+	}
+
+	Subtree left, right;
+	forkJoin([this, less, b](unsigned leftForks, std::vector<AVLNode<Key, Value>*>& leftDropped) {
+	             return differenceTrees(less, b->getLeft(), leftForks, leftDropped);
+	         },
+	         [this, greater, b](unsigned rightForks, std::vector<AVLNode<Key, Value>*>& rightDropped) {
+	             return differenceTrees(greater, b->getRight(), rightForks, rightDropped);
+	         },
+	         forks, a.height, left, right, dropped);
+	return joinTrees(left, right);
+}
+
+/**
+* Runs the two recursive calls of a set operation. If forks allows and
+* the subtrees are tall enough, leftTask runs on a new thread while this
+* one runs rightTask; the remaining forks are split between them. Both
+* only touch their own subtrees, except for the nodes they drop, which
+* the new thread collects separately and hands back when it is joined.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename LeftTask, typename RightTask>
+void AVLTree<Key, Value, Alloc, Stats>::forkJoin(LeftTask leftTask, RightTask rightTask, unsigned forks, int height,
+                                          Subtree& left, Subtree& right,
+                                          std::vector<AVLNode<Key, Value>*>& dropped)
+{
+	if(forks > 0 && height >= PARALLEL_HEIGHT) {
+		unsigned leftForks = (forks - 1) / 2;
+		std::vector<AVLNode<Key, Value>*> leftDropped;
+		std::future<Subtree> pending;
+		try {
+			pending = std::async(std::launch::async, leftTask, leftForks, std::ref(leftDropped));
+		}
+		catch(const std::system_error&) { //No thread to be had: carry on alone
+			forks = 0;
+		}
+		if(forks > 0) {
+			right = rightTask(forks - 1 - leftForks, dropped);
+			left = pending.get();
+			dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+			return;
+		}
+	}
+	left = leftTask(forks, dropped);
+	right = rightTask(forks, dropped);
+}
+
+/**
+* Frees what a set operation dropped: single nodes or whole subtrees,
+* each detached.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::destroyDropped(const std::vector<AVLNode<Key, Value>*>& dropped)
+{
+	for(std::size_t i = 0; i < dropped.size(); ++i) {
+		this->destroySubtree(dropped[i]);
+	}
+}
+
+/**
+* Number of threads to use given a caller's request, where 0 means one
+* per core.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+unsigned AVLTree<Key, Value, Alloc, Stats>::threadCount(unsigned threads)
+{
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	return std::max(threads, 1u);
+}
+
+/**
+* Threads a set operation may start besides the calling one. None for a
+* tree that counts (see tree_stats.h): the rotations on every thread
+* would update the same counters.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+unsigned AVLTree<Key, Value, Alloc, Stats>::forkCount(unsigned threads)
+{
+	if(!std::is_same<Stats, NoTreeStats>::value) {
+		return 0;
+	}
+	return threadCount(threads) - 1;
+}
+
+/**
+* Stable sort of [first, last) by less on up to threads threads: the two
+* halves are sorted concurrently, then merged.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename RandomIt, typename Compare>
+void AVLTree<Key, Value, Alloc, Stats>::sortBatch(RandomIt first, RandomIt last, Compare less, unsigned threads)
+{
+	std::size_t n = static_cast<std::size_t>(last - first);
+	if(threads < 2 || n < 2 * PARALLEL_CHUNK) {
+		std::stable_sort(first, last, less);
+		return;
+	}
+
+	RandomIt middle = first + n / 2;
+	unsigned leftThreads = threads / 2;
+	std::future<void> pending;
+	try {
+		pending = std::async(std::launch::async, &AVLTree::sortBatch<RandomIt, Compare>,
+		                     first, middle, less, leftThreads);
+	}
+	catch(const std::system_error&) {
+		std::stable_sort(first, last, less);
+		return;
+	}
+	sortBatch(middle, last, less, threads - leftThreads);
+	pending.get();
+	std::inplace_merge(first, middle, last, less);
+}
+
+/**
+* Moves every item of upper into this tree, leaving upper empty. Every
+* key in upper must be greater than every key here, otherwise throws
+* std::invalid_argument and changes nothing. upper must be the same kind
+* of tree as this one. O(log n).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::join(AVLTree& upper)
+{
+	if(&upper == this || upper.root_ == nullptr) {
+		return;
+	}
+	if(this->root_ != nullptr && !(this->getLargestNode()->getKey() < upper.getSmallestNode()->getKey())) {
+		throw std::invalid_argument("Keys to join overlap");
+	}
+
+	this->alloc_.share(upper.alloc_);
+	Subtree lower = detach();
+	Subtree higher = upper.detach();
+	Subtree joined = joinTrees(lower, higher);
+	attach(joined);
+	settled(joined.root);
+
+	this->size_ += upper.size_;
+	upper.size_ = 0;
+}
+
+/**
+* Moves the items with keys not less than key into upper, replacing its
+* contents; the items with smaller keys stay here. O(log n) to split,
+* plus the size of the smaller side to count the items each tree ends up
+* with (see countLower()).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::split(const Key& key, AVLTree& upper)
+{
+	if(&upper == this) {
+		return;
+	}
+	upper.clear();
+	upper.alloc_.share(this->alloc_);
+
+	Subtree less, greater;
+	AVLNode<Key, Value>* match;
+	splitTree(detach(), key, less, match, greater);
+	if(match != nullptr) {
+		Subtree empty = { nullptr, 0 };
+		greater = joinTrees(empty, match, greater);
+	}
+	attach(less);
+	upper.attach(greater);
+	settled(less.root);
+	settled(greater.root);
+
+	std::size_t total = this->size_;
+	this->size_ = countLower(less.root, greater.root, total);
+	upper.size_ = total - this->size_;
+}
+
+/**
+* Moves every item of other into this tree (set union), leaving other
+* empty. Where both trees have a key, other's value wins, as if each of
+* its items had been inserted here.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::merge(AVLTree& other, unsigned threads)
+{
+	if(&other == this || other.root_ == nullptr) {
+		return;
+	}
+
+	this->alloc_.share(other.alloc_);
+	this->size_ += other.size_;
+	other.size_ = 0;
+	mergeSubtree(other.detach(), threads);
+}
+
+/**
+* Unions the detached subtree theirs into this tree. Its nodes must
+* already belong to this tree's allocator and be counted in size_.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::mergeSubtree(Subtree theirs, unsigned threads)
+{
+	std::vector<AVLNode<Key, Value>*> dropped;
+	Subtree merged = unionTrees(detach(), theirs, forkCount(threads), dropped);
+	attach(merged);
+	destroyDropped(dropped);
+	settled(merged.root);
+}
+
+/**
+* Removes every item whose key is not in other (set intersection).
+* other is only read.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::intersect(const AVLTree& other, unsigned threads)
+{
+	if(&other == this) {
+		return;
+	}
+	std::vector<AVLNode<Key, Value>*> dropped;
+	Subtree kept = intersectTrees(detach(), static_cast<AVLNode<Key, Value>*>(other.root_),
+	                              forkCount(threads), dropped);
+	attach(kept);
+	destroyDropped(dropped);
+	settled(kept.root);
+}
+
+/**
+* Removes every item whose key is in other (set difference). other is
+* only read.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void AVLTree<Key, Value, Alloc, Stats>::difference(const AVLTree& other, unsigned threads)
+{
+	if(&other == this) {
+		this->clear();
+		return;
+	}
+	std::vector<AVLNode<Key, Value>*> dropped;
+	Subtree kept = differenceTrees(detach(), static_cast<AVLNode<Key, Value>*>(other.root_),
+	                               forkCount(threads), dropped);
+	attach(kept);
+	destroyDropped(dropped);
+	settled(kept.root);
+}
+
+/**
+* Inserts the key/value pairs in [first, last), as if by insert() in
+* order: they overwrite existing values, and later duplicates in the
+* batch win over earlier ones.
+*
+* The batch is copied and sorted on up to threads threads (0 means one
+* per core), each run of equal keys is reduced to its last pair, and the
+* result is cut into chunks that are bulk loaded into separate trees
+* concurrently (each tree has its own allocator) in O(n). The chunks are
+* joined and the batch tree merged in with the parallel union, which
+* rebalances disjoint subtrees on different threads.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc, Stats>::insert_batch(ForwardIt first, ForwardIt last, unsigned threads)
+{
+	typedef std::pair<Key, Value> Item;
+	std::vector<Item> batch(first, last);
+	if(batch.empty()) {
+		return;
+	}
+	threads = threadCount(threads);
+
+	sortBatch(batch.begin(), batch.end(), [](const Item& lhs, const Item& rhs) {
+		return lhs.first < rhs.first;
+	}, threads);
+
+	std::size_t kept = 1;
+	for(std::size_t i = 1; i < batch.size(); ++i) {
+		if(batch[kept - 1].first < batch[i].first) {
+			batch[kept++] = std::move(batch[i]);
+		}
+		else { //Same key: the later pair wins
+			batch[kept - 1] = std::move(batch[i]);
+		}
+	}
+	batch.erase(batch.begin() + kept, batch.end());
+
+	std::size_t chunks = std::min<std::size_t>(threads, (batch.size() + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK);
+	std::vector<AVLTree> parts(chunks);
+	std::vector<std::future<void> > pending;
+	for(std::size_t i = 0; i < chunks; ++i) {
+		typename std::vector<Item>::iterator lo = batch.begin() + i * batch.size() / chunks;
+		typename std::vector<Item>::iterator hi = batch.begin() + (i + 1) * batch.size() / chunks;
+		AVLTree* part = &parts[i];
+		//The parts are plain AVLTrees, so this tree's hook finishes them
+		auto build = [this, part, lo, hi]() {
+			part->assign(lo, hi);
+			restructured(static_cast<AVLNode<Key, Value>*>(part->root_));
+		};
+		if(i + 1 < chunks) {
+			try {
+				pending.push_back(std::async(std::launch::async, build));
+				continue;
+			}
+			catch(const std::system_error&) {
+			}
+		}
+		build();
+	}
+	for(std::size_t i = 0; i < pending.size(); ++i) {
+		pending[i].get();
+	}
+
+	Subtree theirs = { nullptr, 0 };
+	for(std::size_t i = 0; i < chunks; ++i) {
+		this->alloc_.share(parts[i].alloc_);
+		this->size_ += parts[i].size_;
+		parts[i].size_ = 0;
+		theirs = joinTrees(theirs, parts[i].detach());
+	}
+	mergeSubtree(theirs, threads);
+}
+
 #endif
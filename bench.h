@@ -0,0 +1,339 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+* A small microbenchmark harness modelled on Google Benchmark, so results
+* can be tracked with the same tooling. A benchmark is a function taking a
+* BenchState and looping on keepRunning():
+*
+*   void BM_Find(BenchState& state)
+*   {
+*       Tree t = build(state.range());      // not timed, runs once
+*       while(state.keepRunning()) {
+*           ...                             // timed
+*       }
+*       state.setItemsProcessed(state.iterations() * state.range());
+*   }
+*
+* Register benchmarks with a BenchRunner and call run(argc, argv), which
+* understands the following Google Benchmark flags:
+*
+*   --benchmark_filter=<substring>    only run benchmarks whose name contains it
+*   --benchmark_format=console|json   format written to stdout
+*   --benchmark_out=<file>            also write JSON results to a file
+*   --benchmark_min_time=<seconds>    minimum timed duration per benchmark
+*/
+
+class BenchState
+{
+public:
+    BenchState(long range, long iterations);
+
+    bool keepRunning();
+    void pauseTiming();
+    void resumeTiming();
+
+    long range() const { return range_; }
+    long iterations() const { return maxIterations_; }
+    void setItemsProcessed(long items) { items_ = items; }
+    long itemsProcessed() const { return items_; }
+    double elapsedSeconds() const { return elapsed_; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    long range_;
+    long maxIterations_;
+    long iteration_;
+    long items_;
+    bool running_;
+    double elapsed_;
+    Clock::time_point start_;
+};
+
+class BenchRunner
+{
+public:
+    typedef void (*BenchFunction)(BenchState&);
+
+    void add(const std::string& name, BenchFunction fn, long range);
+    void add(const std::string& name, BenchFunction fn, const std::vector<long>& ranges);
+    void addContext(const std::string& key, const std::string& value);
+    int run(int argc, char* argv[]);
+
+private:
+    struct Bench
+    {
+        std::string name;
+        BenchFunction fn;
+        long range;
+    };
+
+    struct Result
+    {
+        std::string name;
+        long iterations;
+        double nsPerIteration;
+        double itemsPerSecond;
+    };
+
+    Result runOne(const Bench& bench, double minTime) const;
+    static std::string jsonEscape(const std::string& text);
+    std::string toJson(const std::vector<Result>& results) const;
+
+    std::vector<Bench> benches_;
+    std::vector<std::pair<std::string, std::string> > context_;
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the BenchState class.
+  ----------------------------------------------
+*/
+
+inline BenchState::BenchState(long range, long iterations) :
+    range_(range),
+    maxIterations_(iterations),
+    iteration_(0),
+    items_(0),
+    running_(false),
+    elapsed_(0.0)
+{
+
+}
+
+/**
+* Starts the clock on the first call and stops it once the requested
+* number of iterations has run.
+*/
+inline bool BenchState::keepRunning()
+{
+    if(!running_) {
+        running_ = true;
+        start_ = Clock::now();
+    }
+    if(iteration_ < maxIterations_) {
+        ++iteration_;
+        return true;
+    }
+    pauseTiming();
+    return false;
+}
+
+/**
+* Excludes the following code (e.g. per-iteration setup) from the timing.
+*/
+inline void BenchState::pauseTiming()
+{
+    if(running_) {
+        elapsed_ += std::chrono::duration<double>(Clock::now() - start_).count();
+        running_ = false;
+    }
+}
+
+inline void BenchState::resumeTiming()
+{
+    if(!running_) {
+        running_ = true;
+        start_ = Clock::now();
+    }
+}
+
+/*
+  --------------------------------------------
+  End implementations for the BenchState class.
+  --------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BenchRunner class.
+  -----------------------------------------------
+*/
+
+inline void BenchRunner::add(const std::string& name, BenchFunction fn, long range)
+{
+    Bench bench;
+    std::ostringstream fullName;
+    fullName << name << "/" << range;
+    bench.name = fullName.str();
+    bench.fn = fn;
+    bench.range = range;
+    benches_.push_back(bench);
+}
+
+inline void BenchRunner::add(const std::string& name, BenchFunction fn, const std::vector<long>& ranges)
+{
+    for(std::size_t i = 0; i < ranges.size(); ++i) {
+        add(name, fn, ranges[i]);
+    }
+}
+
+/**
+* Adds a key/value pair to the "context" section of the JSON output.
+*/
+inline void BenchRunner::addContext(const std::string& key, const std::string& value)
+{
+    context_.push_back(std::make_pair(key, value));
+}
+
+/**
+* Runs a benchmark with a growing iteration count until one run takes at
+* least minTime, and reports that run. A benchmark whose timed part is
+* tiny next to its untimed setup would grow forever, so runs are also
+* kept to about 10 * minTime of wall-clock time.
+*/
+inline BenchRunner::Result BenchRunner::runOne(const Bench& bench, double minTime) const
+{
+    typedef std::chrono::steady_clock Clock;
+    long iterations = 1;
+    while(true) {
+        BenchState state(bench.range, iterations);
+        Clock::time_point start = Clock::now();
+        bench.fn(state);
+        double wall = std::chrono::duration<double>(Clock::now() - start).count();
+        double elapsed = state.elapsedSeconds();
+
+        if(elapsed >= minTime || wall >= 10 * minTime || iterations >= 1000000000L) {
+            Result result;
+            result.name = bench.name;
+            result.iterations = iterations;
+            result.nsPerIteration = elapsed * 1e9 / iterations;
+            result.itemsPerSecond = (elapsed > 0.0) ? state.itemsProcessed() / elapsed : 0.0;
+            return result;
+        }
+
+        // Aim a little past minTime, growing at most 10x per attempt
+        double scale = (elapsed > 0.0) ? (minTime * 1.4 / elapsed) : 10.0;
+        if(scale > 10.0) {
+            scale = 10.0;
+        }
+        if(wall > 0.0 && wall * scale > 10 * minTime) {
+            scale = 10 * minTime / wall;
+        }
+        long next = static_cast<long>(iterations * scale);
+        iterations = (next > iterations) ? next : iterations + 1;
+    }
+}
+
+inline std::string BenchRunner::jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for(std::size_t i = 0; i < text.size(); ++i) {
+        if(text[i] == '"' || text[i] == '\\') {
+            escaped += '\\';
+        }
+        escaped += text[i];
+    }
+    return escaped;
+}
+
+inline std::string BenchRunner::toJson(const std::vector<Result>& results) const
+{
+    std::ostringstream out;
+    out << "{\n  \"context\": {\n";
+    for(std::size_t i = 0; i < context_.size(); ++i) {
+        out << "    \"" << jsonEscape(context_[i].first) << "\": \"" << jsonEscape(context_[i].second) << "\""
+            << (i + 1 < context_.size() ? ",\n" : "\n");
+    }
+    out << "  },\n  \"benchmarks\": [\n";
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        out << "    {\n"
+            << "      \"name\": \"" << jsonEscape(results[i].name) << "\",\n"
+            << "      \"iterations\": " << results[i].iterations << ",\n"
+            << "      \"real_time\": " << results[i].nsPerIteration << ",\n"
+            << "      \"time_unit\": \"ns\",\n"
+            << "      \"items_per_second\": " << results[i].itemsPerSecond << "\n"
+            << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+/**
+* Parses the command line, runs every matching benchmark and prints the
+* results. Returns the process exit code.
+*/
+inline int BenchRunner::run(int argc, char* argv[])
+{
+    std::string filter;
+    std::string format = "console";
+    std::string outPath;
+    double minTime = 0.5;
+
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string::size_type eq = arg.find('=');
+        std::string flag = arg.substr(0, eq);
+        std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+
+        if(flag == "--benchmark_filter") {
+            filter = value;
+        }
+        else if(flag == "--benchmark_format") {
+            format = value;
+        }
+        else if(flag == "--benchmark_out") {
+            outPath = value;
+        }
+        else if(flag == "--benchmark_min_time") {
+            minTime = std::atof(value.c_str());
+        }
+        else {
+            std::cerr << "unknown flag: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    bool console = (format != "json");
+    if(console) {
+        std::printf("%-44s %16s %12s %14s\n", "Benchmark", "Time (ns)", "Iterations", "Items/s");
+        std::printf("%s\n", std::string(89, '-').c_str());
+    }
+
+    std::vector<Result> results;
+    for(std::size_t i = 0; i < benches_.size(); ++i) {
+        if(!filter.empty() && benches_[i].name.find(filter) == std::string::npos) {
+            continue;
+        }
+        Result result = runOne(benches_[i], minTime);
+        results.push_back(result);
+        if(console) {
+            std::printf("%-44s %16.0f %12ld %14.4g\n", result.name.c_str(),
+                        result.nsPerIteration, result.iterations, result.itemsPerSecond);
+            std::fflush(stdout);
+        }
+    }
+
+    std::string json = toJson(results);
+    if(!console) {
+        std::cout << json;
+    }
+    if(!outPath.empty()) {
+        std::ofstream out(outPath.c_str());
+        if(!out) {
+            std::cerr << "could not write " << outPath << std::endl;
+            return 1;
+        }
+        out << json;
+    }
+    return 0;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BenchRunner class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,876 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "bst.h"
+#include "avlbst.h"
+#include "order_statistic.h"
+#include "threaded_avl.h"
+#include "btree.h"
+#include "concurrent_avl.h"
+#include "indexed_avl.h"
+#include "frozen_map.h"
+#include "snapshot.h"
+#include "stream_loader.h"
+#include "bench.h"
+
+using namespace std;
+
+// Benchmarks for BinarySearchTree, AVLTree and BTreeMap against std::map.
+// Build with 'make bench' and run ./bst-bench (see bench.h for flags).
+
+typedef BinarySearchTree<int,int> BST;
+typedef AVLTree<int,int> AVL;
+typedef AVLTree<int,int,NodePool<AVLNode<int,int> >,TreeStats> AVLStats;
+typedef OrderStatisticTree<int,int> Ranked;
+typedef ThreadedAVLTree<int,int> Threaded;
+typedef BTreeMap<int,int> BTree;
+
+// An int that key_search.h does not recognise, so a BTreeMap of them
+// searches its nodes with the scalar binary search
+struct ScalarInt
+{
+    ScalarInt(int v = 0) : value(v) {}
+    int value;
+};
+
+inline bool operator<(ScalarInt a, ScalarInt b)
+{
+    return a.value < b.value;
+}
+
+typedef BTreeMap<ScalarInt,int> ScalarBTree;
+typedef IndexedAVLTree<int,int> Indexed;
+typedef std::map<int,int> StdMap;
+typedef ConcurrentAVLTree<int,int> ConcurrentAVL;
+
+static volatile long sink;
+
+static string toString(size_t value)
+{
+    ostringstream out;
+    out << value;
+    return out.str();
+}
+
+// Tree keys are the even numbers 0, 2, ..., 2(n-1) so odd keys always miss.
+static const vector<int>& sequentialKeys(long n)
+{
+    static map<long, vector<int> > cache;
+    vector<int>& keys = cache[n];
+    if(keys.empty()) {
+        for(long i = 0; i < n; ++i) {
+            keys.push_back(static_cast<int>(2 * i));
+        }
+    }
+    return keys;
+}
+
+static const vector<int>& shuffledKeys(long n)
+{
+    static map<long, vector<int> > cache;
+    vector<int>& keys = cache[n];
+    if(keys.empty()) {
+        keys = sequentialKeys(n);
+        srand(42);
+        for(long i = n - 1; i > 0; --i) {
+            swap(keys[i], keys[rand() % (i + 1)]);
+        }
+    }
+    return keys;
+}
+
+// Small adapters so one benchmark body covers all three containers.
+template<typename Tree>
+void treeRemove(Tree& tree, int key)
+{
+    tree.remove(key);
+}
+
+void treeRemove(StdMap& tree, int key)
+{
+    tree.erase(key);
+}
+
+template<typename Tree>
+void fill(Tree& tree, const vector<int>& keys)
+{
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(std::make_pair(keys[i], keys[i]));
+    }
+}
+
+template<typename Tree>
+void insertBench(BenchState& state, const vector<int>& keys)
+{
+    while(state.keepRunning()) {
+        Tree* tree = new Tree;
+        fill(*tree, keys);
+        state.pauseTiming();
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+template<typename Tree>
+void BM_InsertSequential(BenchState& state)
+{
+    insertBench<Tree>(state, sequentialKeys(state.range()));
+}
+
+template<typename Tree>
+void BM_InsertRandom(BenchState& state)
+{
+    insertBench<Tree>(state, shuffledKeys(state.range()));
+}
+
+template<typename Tree>
+void BM_InsertReverse(BenchState& state)
+{
+    vector<int> keys(sequentialKeys(state.range()).rbegin(), sequentialKeys(state.range()).rend());
+    insertBench<Tree>(state, keys);
+}
+
+template<typename Tree>
+void findBench(BenchState& state, int offset)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    Tree tree;
+    fill(tree, keys);
+
+    long found = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < keys.size(); ++i) {
+            found += (tree.find(keys[i] + offset) != tree.end());
+        }
+    }
+    sink = found;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+template<typename Tree>
+void BM_FindHit(BenchState& state)
+{
+    findBench<Tree>(state, 0);
+}
+
+template<typename Tree>
+void BM_FindMiss(BenchState& state)
+{
+    findBench<Tree>(state, 1);
+}
+
+template<typename Tree>
+void BM_Remove(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    vector<int> order(keys.rbegin(), keys.rend());
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        Tree* tree = new Tree;
+        fill(*tree, keys);
+        state.resumeTiming();
+
+        for(size_t i = 0; i < order.size(); ++i) {
+            treeRemove(*tree, order[i]);
+        }
+
+        state.pauseTiming();
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+template<typename Tree>
+void BM_Iterate(BenchState& state)
+{
+    Tree tree;
+    fill(tree, shuffledKeys(state.range()));
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            sum += it->second;
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+template<typename Tree>
+void BM_IterateReverse(BenchState& state)
+{
+    Tree tree;
+    fill(tree, shuffledKeys(state.range()));
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(typename Tree::reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+            sum += it->second;
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+template<typename Tree>
+void BM_Clear(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        Tree tree;
+        fill(tree, keys);
+        state.resumeTiming();
+
+        tree.clear();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Windows of 100 consecutive keys starting at random positions
+template<typename Tree>
+void rangeScanBench(BenchState& state, long (*scan)(const Tree&, int, int))
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    Tree tree;
+    fill(tree, keys);
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < 1000; ++i) {
+            int lo = keys[i % keys.size()];
+            sum += scan(tree, lo, lo + 200);
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * 1000);
+}
+
+long scanAVL(const AVL& tree, int lo, int hi)
+{
+    long sum = 0;
+    AVL::Range window = tree.range(lo, hi);
+    for(AVL::iterator it = window.begin(); it != window.end(); ++it) {
+        sum += it->second;
+    }
+    return sum;
+}
+
+long scanStdMap(const StdMap& tree, int lo, int hi)
+{
+    long sum = 0;
+    StdMap::const_iterator last = tree.lower_bound(hi);
+    for(StdMap::const_iterator it = tree.lower_bound(lo); it != last; ++it) {
+        sum += it->second;
+    }
+    return sum;
+}
+
+void BM_AVLRangeScan(BenchState& state)
+{
+    rangeScanBench<AVL>(state, scanAVL);
+}
+
+void BM_StdMapRangeScan(BenchState& state)
+{
+    rangeScanBench<StdMap>(state, scanStdMap);
+}
+
+void BM_AVLBulkLoadSorted(BenchState& state)
+{
+    const vector<int>& keys = sequentialKeys(state.range());
+    vector<pair<int,int> > snapshot;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        snapshot.push_back(make_pair(keys[i], keys[i]));
+    }
+
+    while(state.keepRunning()) {
+        AVL* tree = new AVL(snapshot.begin(), snapshot.end());
+        state.pauseTiming();
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Items in the large benchmarks
+static const long PARALLEL_ITEMS = 1000000;
+
+// Lookups in requests of 256 keys each, through find_batch() or a loop
+// over find(). Every key hits.
+static const size_t BATCH_KEYS = 256;
+
+// The tree's keys in a different random order from the one they were
+// inserted in, so lookups do not follow the allocation order.
+static vector<int> lookupOrder(const vector<int>& keys)
+{
+    vector<int> lookups = keys;
+    srand(7);
+    for(size_t i = lookups.size(); i > 1; --i) {
+        swap(lookups[i - 1], lookups[rand() % i]);
+    }
+    return lookups;
+}
+
+template<typename Tree, bool Batch>
+void BM_FindBatch(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    Tree tree;
+    fill(tree, keys);
+
+    vector<vector<int> > requests;
+    vector<int> lookups = lookupOrder(keys);
+    for(size_t i = 0; i < lookups.size(); i += BATCH_KEYS) {
+        requests.push_back(vector<int>(lookups.begin() + i, lookups.begin() + min(i + BATCH_KEYS, lookups.size())));
+    }
+
+    long sum = 0;
+    vector<typename Tree::iterator> out;
+    while(state.keepRunning()) {
+        for(size_t r = 0; r < requests.size(); ++r) {
+            const vector<int>& request = requests[r];
+            if(Batch) {
+                tree.find_batch(request, out);
+                for(size_t i = 0; i < out.size(); ++i) {
+                    sum += out[i]->second;
+                }
+            }
+            else {
+                for(size_t i = 0; i < request.size(); ++i) {
+                    sum += tree.find(request[i])->second;
+                }
+            }
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// The lookups of AVL/FindLoop, for containers without find_batch()
+template<typename Tree>
+void BM_FindLoop(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    Tree tree;
+    fill(tree, keys);
+    vector<int> lookups = lookupOrder(keys);
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < lookups.size(); ++i) {
+            sum += tree.find(lookups[i])->second;
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// The lookups of AVL/FindLoop against a frozen snapshot of the same tree
+static void BM_FrozenFind(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    AVL tree;
+    fill(tree, keys);
+    FrozenMap<int,int> frozen = freeze(tree);
+    vector<int> lookups = lookupOrder(keys);
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < lookups.size(); ++i) {
+            sum += frozen.find(lookups[i])->second;
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// String keys too long for the small-string buffer, so that building a
+// std::string for a lookup allocates
+static const vector<string>& stringKeys(long n)
+{
+    static map<long, vector<string> > cache;
+    vector<string>& keys = cache[n];
+    if(keys.empty()) {
+        const vector<int>& ints = shuffledKeys(n);
+        for(long i = 0; i < n; ++i) {
+            keys.push_back("customer-account-" + toString(ints[i]));
+        }
+    }
+    return keys;
+}
+
+// Looking up string keys given as const char*: converted to std::string
+// first, or compared directly through the transparent find()
+template<bool Transparent>
+static void BM_StringFind(BenchState& state)
+{
+    const vector<string>& keys = stringKeys(state.range());
+    AVLTree<string,int> tree;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    vector<const char*> lookups;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        lookups.push_back(keys[keys.size() - 1 - i].c_str());
+    }
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < lookups.size(); ++i) {
+            if(Transparent) {
+                sum += tree.find(lookups[i])->second;
+            }
+            else {
+                sum += tree.find(string(lookups[i]))->second;
+            }
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Snapshots go to this file in the working directory, which is removed
+// after each benchmark.
+static const char* SNAPSHOT_PATH = "bst-bench-snapshot.bin";
+
+static void BM_SnapshotSave(BenchState& state)
+{
+    AVL tree;
+    fill(tree, shuffledKeys(state.range()));
+    while(state.keepRunning()) {
+        saveSnapshot(tree, SNAPSHOT_PATH);
+    }
+    remove(SNAPSHOT_PATH);
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Restarting from a snapshot; compare with AVL/InsertRandom
+static void BM_SnapshotLoad(BenchState& state)
+{
+    {
+        AVL tree;
+        fill(tree, shuffledKeys(state.range()));
+        saveSnapshot(tree, SNAPSHOT_PATH);
+    }
+    while(state.keepRunning()) {
+        AVL* tree = new AVL;
+        loadSnapshot(*tree, SNAPSHOT_PATH);
+        state.pauseTiming();
+        sink = static_cast<long>(tree->size());
+        delete tree;
+        state.resumeTiming();
+    }
+    remove(SNAPSHOT_PATH);
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Opening a mapped view, then the lookups of AVL/FindLoop through it
+static void BM_MappedOpen(BenchState& state)
+{
+    {
+        AVL tree;
+        fill(tree, shuffledKeys(state.range()));
+        saveSnapshot(tree, SNAPSHOT_PATH);
+    }
+    while(state.keepRunning()) {
+        MappedSnapshot<int,int> view(SNAPSHOT_PATH);
+        sink = static_cast<long>(view.size());
+    }
+    remove(SNAPSHOT_PATH);
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+static void BM_MappedFind(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    {
+        AVL tree;
+        fill(tree, keys);
+        saveSnapshot(tree, SNAPSHOT_PATH);
+    }
+    MappedSnapshot<int,int> view(SNAPSHOT_PATH);
+    vector<int> lookups = lookupOrder(keys);
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < lookups.size(); ++i) {
+            sum += view.find(lookups[i])->second;
+        }
+    }
+    sink = sum;
+    remove(SNAPSHOT_PATH);
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// n records as "key value" lines, in key order or shuffled
+static const string& recordText(long n, bool sorted)
+{
+    static map<pair<long, bool>, string> cache;
+    string& text = cache[make_pair(n, sorted)];
+    if(text.empty()) {
+        const vector<int>& keys = sorted ? sequentialKeys(n) : shuffledKeys(n);
+        ostringstream out;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            out << keys[i] << " " << i << "\n";
+        }
+        text = out.str();
+    }
+    return text;
+}
+
+// Parsing the records and loading them with loadStream(), or inserting
+// them one at a time as they are read
+template<bool Sorted, bool Stream>
+void BM_StreamLoad(BenchState& state)
+{
+    const string& text = recordText(state.range(), Sorted);
+    while(state.keepRunning()) {
+        istringstream in(text);
+        AVL* tree = new AVL;
+        if(Stream) {
+            loadStream(*tree, in);
+        }
+        else {
+            int key, value;
+            while(in >> key >> value) {
+                tree->insert(make_pair(key, value));
+            }
+        }
+        state.pauseTiming();
+        sink = static_cast<long>(tree->size());
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Union of two trees of n items each, half of the keys shared: merge()
+// against inserting the second tree's items one by one. Building the
+// trees is not timed.
+static void splitKeys(const vector<int>& keys, vector<int>& firstKeys, vector<int>& secondKeys)
+{
+    for(size_t i = 0; i < keys.size(); ++i) {
+        if(keys[i] % 4 == 0 || keys[i] % 8 == 2) {
+            firstKeys.push_back(keys[i]);
+        }
+        if(keys[i] % 4 == 0 || keys[i] % 8 == 6) {
+            secondKeys.push_back(keys[i]);
+        }
+    }
+}
+
+template<bool Join>
+void BM_AVLUnion(BenchState& state)
+{
+    vector<int> firstKeys, secondKeys;
+    splitKeys(shuffledKeys(state.range()), firstKeys, secondKeys);
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        AVL* first = new AVL;
+        AVL* second = new AVL;
+        fill(*first, firstKeys);
+        fill(*second, secondKeys);
+        state.resumeTiming();
+
+        if(Join) {
+            first->merge(*second, 1);
+        }
+        else {
+            for(AVL::iterator it = second->begin(); it != second->end(); ++it) {
+                first->insert(*it);
+            }
+        }
+
+        state.pauseTiming();
+        sink = static_cast<long>(first->size());
+        delete first;
+        delete second;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// Scaling with threads (the range): a batch of a million pairs, each
+// key appearing twice, inserted into a tree of 100000 items; and
+// the union of two trees of half a million items each.
+
+void BM_AVLInsertBatch(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(PARALLEL_ITEMS);
+    vector<pair<int,int> > batch;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        batch.push_back(make_pair(keys[i] - keys[i] % 4, keys[i]));
+    }
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        AVL* tree = new AVL;
+        fill(*tree, shuffledKeys(100000));
+        state.resumeTiming();
+
+        tree->insert_batch(batch.begin(), batch.end(), static_cast<unsigned>(state.range()));
+
+        state.pauseTiming();
+        sink = static_cast<long>(tree->size());
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * PARALLEL_ITEMS);
+}
+
+// The same batch through insert(), for comparison
+void BM_AVLInsertLoop(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(PARALLEL_ITEMS);
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        AVL* tree = new AVL;
+        fill(*tree, shuffledKeys(100000));
+        state.resumeTiming();
+
+        for(size_t i = 0; i < keys.size(); ++i) {
+            tree->insert(make_pair(keys[i] - keys[i] % 4, keys[i]));
+        }
+
+        state.pauseTiming();
+        sink = static_cast<long>(tree->size());
+        delete tree;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * PARALLEL_ITEMS);
+}
+
+void BM_AVLParallelUnion(BenchState& state)
+{
+    vector<int> firstKeys, secondKeys;
+    splitKeys(shuffledKeys(PARALLEL_ITEMS), firstKeys, secondKeys);
+
+    while(state.keepRunning()) {
+        state.pauseTiming();
+        AVL* first = new AVL;
+        AVL* second = new AVL;
+        fill(*first, firstKeys);
+        fill(*second, secondKeys);
+        state.resumeTiming();
+
+        first->merge(*second, static_cast<unsigned>(state.range()));
+
+        state.pauseTiming();
+        sink = static_cast<long>(first->size());
+        delete first;
+        delete second;
+        state.resumeTiming();
+    }
+    state.setItemsProcessed(state.iterations() * PARALLEL_ITEMS);
+}
+
+void BM_RankedSelect(BenchState& state)
+{
+    Ranked tree;
+    fill(tree, shuffledKeys(state.range()));
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(long k = 0; k < state.range(); ++k) {
+            sum += tree.select(static_cast<size_t>(k))->second;
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+void BM_RankedRank(BenchState& state)
+{
+    const vector<int>& keys = shuffledKeys(state.range());
+    Ranked tree;
+    fill(tree, keys);
+
+    long sum = 0;
+    while(state.keepRunning()) {
+        for(size_t i = 0; i < keys.size(); ++i) {
+            sum += tree.rank(keys[i]);
+        }
+    }
+    sink = sum;
+    state.setItemsProcessed(state.iterations() * state.range());
+}
+
+// An AVLTree behind one mutex, the baseline for ConcurrentAVLTree.
+class LockedAVL
+{
+public:
+    bool find(int key, int& value) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AVL::iterator it = tree_.find(key);
+        if(it == tree_.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void insert(const pair<const int, int>& keyValuePair)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tree_.insert(keyValuePair);
+    }
+
+    void remove(int key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tree_.remove(key);
+    }
+
+private:
+    AVL tree_;
+    mutable std::mutex mutex_;
+};
+
+// state.range() reader threads each do a fixed number of lookups while one
+// writer thread keeps inserting and removing the odd keys. Reports total
+// lookups per second across all readers.
+template<typename Map>
+void BM_ConcurrentReads(BenchState& state)
+{
+    const long LOOKUPS_PER_THREAD = 100000;
+    const vector<int>& keys = shuffledKeys(100000);
+    Map map;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        map.insert(std::make_pair(keys[i], keys[i]));
+    }
+
+    long found = 0;
+    while(state.keepRunning()) {
+        std::atomic<long> running(state.range());
+        std::atomic<long> hits(0);
+        vector<std::thread> readers;
+        for(long r = 0; r < state.range(); ++r) {
+            readers.push_back(std::thread([&map, &keys, &running, &hits, r, LOOKUPS_PER_THREAD]() {
+                long local = 0;
+                int value;
+                size_t k = static_cast<size_t>(r) * 7919;
+                for(long i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+                    local += map.find(keys[k % keys.size()], value);
+                    ++k;
+                }
+                hits += local;
+                --running;
+            }));
+        }
+
+        int key = 1;
+        while(running.load() > 0) {
+            map.insert(std::make_pair(key, key));
+            map.remove(key);
+            key = (key + 2) % 200000;
+        }
+        for(size_t i = 0; i < readers.size(); ++i) {
+            readers[i].join();
+        }
+        found += hits.load();
+    }
+    sink = found;
+    state.setItemsProcessed(state.iterations() * state.range() * LOOKUPS_PER_THREAD);
+}
+
+template<typename Tree>
+void addSuite(BenchRunner& runner, const string& name, const vector<long>& sizes, const vector<long>& sortedSizes)
+{
+    runner.add(name + "/InsertSequential", BM_InsertSequential<Tree>, sortedSizes);
+    runner.add(name + "/InsertRandom", BM_InsertRandom<Tree>, sizes);
+    runner.add(name + "/InsertReverse", BM_InsertReverse<Tree>, sortedSizes);
+    runner.add(name + "/FindHit", BM_FindHit<Tree>, sizes);
+    runner.add(name + "/FindMiss", BM_FindMiss<Tree>, sizes);
+    runner.add(name + "/Remove", BM_Remove<Tree>, sizes);
+    runner.add(name + "/Iterate", BM_Iterate<Tree>, sizes);
+    runner.add(name + "/Clear", BM_Clear<Tree>, sizes);
+}
+
+int main(int argc, char *argv[])
+{
+    vector<long> sizes;
+    sizes.push_back(1000);
+    sizes.push_back(100000);
+
+    // Sorted input degenerates the plain BST into a list, so keep it small
+    vector<long> smallSizes;
+    smallSizes.push_back(1000);
+
+    BenchRunner runner;
+    runner.addContext("sizeof(Node<int,int>)", toString(sizeof(Node<int,int>)));
+    runner.addContext("sizeof(AVLNode<int,int>)", toString(sizeof(AVLNode<int,int>)));
+    runner.addContext("sizeof(ThreadedAVLNode<int,int>)", toString(sizeof(ThreadedAVLNode<int,int>)));
+    runner.addContext("IndexedAVLTree<int,int>::NODE_BYTES", toString(Indexed::NODE_BYTES));
+    runner.addContext("BTreeMap<int,int>::LEAF_SLOTS", toString(BTree::LEAF_SLOTS));
+
+    addSuite<BST>(runner, "BST", sizes, smallSizes);
+    addSuite<AVL>(runner, "AVL", sizes, sizes);
+    addSuite<Ranked>(runner, "Ranked", sizes, sizes);
+    addSuite<Threaded>(runner, "Threaded", sizes, sizes);
+    addSuite<Indexed>(runner, "Indexed", sizes, sizes);
+    addSuite<BTree>(runner, "BTree", sizes, sizes);
+    addSuite<StdMap>(runner, "StdMap", sizes, sizes);
+    runner.add("AVLStats/InsertRandom", BM_InsertRandom<AVLStats>, sizes);
+    runner.add("AVLStats/FindHit", BM_FindHit<AVLStats>, sizes);
+    runner.add("AVLStats/Remove", BM_Remove<AVLStats>, sizes);
+    runner.add("AVL/BulkLoadSorted", BM_AVLBulkLoadSorted, sizes);
+    runner.add("AVL/IterateReverse", BM_IterateReverse<AVL>, sizes);
+    runner.add("StdMap/IterateReverse", BM_IterateReverse<StdMap>, sizes);
+    runner.add("Threaded/IterateReverse", BM_IterateReverse<Threaded>, sizes);
+    runner.add("AVL/RangeScan", BM_AVLRangeScan, sizes);
+    runner.add("StdMap/RangeScan", BM_StdMapRangeScan, sizes);
+    vector<long> lookupSizes = sizes;
+    lookupSizes.push_back(PARALLEL_ITEMS);
+    runner.add("AVL/FindLoop", BM_FindBatch<AVL, false>, lookupSizes);
+    runner.add("AVL/FindBatch", BM_FindBatch<AVL, true>, lookupSizes);
+    runner.add("Indexed/FindLoop", BM_FindBatch<Indexed, false>, lookupSizes);
+    runner.add("Indexed/FindBatch", BM_FindBatch<Indexed, true>, lookupSizes);
+    runner.add("Threaded/FindLoop", BM_FindBatch<Threaded, false>, lookupSizes);
+    runner.add("Threaded/FindBatch", BM_FindBatch<Threaded, true>, lookupSizes);
+    runner.add("Frozen/FindLoop", BM_FrozenFind, lookupSizes);
+    runner.add("AVLString/FindConverted", BM_StringFind<false>, sizes);
+    runner.add("AVLString/FindTransparent", BM_StringFind<true>, sizes);
+    runner.add("BTree/FindLoop", BM_FindLoop<BTree>, lookupSizes);
+    runner.add("BTreeScalar/FindLoop", BM_FindLoop<ScalarBTree>, lookupSizes);
+    runner.add("AVL/SnapshotSave", BM_SnapshotSave, lookupSizes);
+    runner.add("AVL/SnapshotLoad", BM_SnapshotLoad, lookupSizes);
+    runner.add("Mapped/Open", BM_MappedOpen, lookupSizes);
+    runner.add("Mapped/FindLoop", BM_MappedFind, lookupSizes);
+    runner.add("AVL/StreamLoadSorted", BM_StreamLoad<true, true>, lookupSizes);
+    runner.add("AVL/StreamInsertSorted", BM_StreamLoad<true, false>, lookupSizes);
+    runner.add("AVL/StreamLoadShuffled", BM_StreamLoad<false, true>, lookupSizes);
+    runner.add("AVL/StreamInsertShuffled", BM_StreamLoad<false, false>, lookupSizes);
+    runner.add("AVL/UnionMerge", BM_AVLUnion<true>, sizes);
+    runner.add("AVL/UnionInsertLoop", BM_AVLUnion<false>, sizes);
+    runner.add("Ranked/Select", BM_RankedSelect, sizes);
+    runner.add("Ranked/Rank", BM_RankedRank, sizes);
+
+    // Reader thread counts, up to the cores available
+    vector<long> threads;
+    long cores = std::thread::hardware_concurrency();
+    for(long t = 1; t <= cores || t == 1; t *= 2) {
+        threads.push_back(t);
+    }
+    runner.addContext("hardware_concurrency", toString(cores));
+    runner.add("LockedAVL/ConcurrentReads", BM_ConcurrentReads<LockedAVL>, threads);
+    runner.add("ConcurrentAVL/ConcurrentReads", BM_ConcurrentReads<ConcurrentAVL>, threads);
+    runner.add("AVL/InsertLoop1M", BM_AVLInsertLoop, 1);
+    runner.add("AVL/InsertBatch1M", BM_AVLInsertBatch, threads);
+    runner.add("AVL/ParallelUnion1M", BM_AVLParallelUnion, threads);
+
+    return runner.run(argc, argv);
+}
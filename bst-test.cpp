@@ -1,10 +1,56 @@
 #include <iostream>
 #include <map>
+#include <vector>
+#include <string>
+#include <stdexcept>
 #include "bst.h"
 #include "avlbst.h"
+#include "order_statistic.h"
+#include "threaded_avl.h"
 
 using namespace std;
 
+// An int key that counts the comparisons made with it
+struct TallyKey
+{
+    int key;
+    static unsigned long tally;
+};
+unsigned long TallyKey::tally = 0;
+
+bool operator==(const TallyKey& lhs, const TallyKey& rhs) { ++TallyKey::tally; return lhs.key == rhs.key; }
+bool operator<(const TallyKey& lhs, const TallyKey& rhs) { ++TallyKey::tally; return lhs.key < rhs.key; }
+bool operator>(const TallyKey& lhs, const TallyKey& rhs) { ++TallyKey::tally; return lhs.key > rhs.key; }
+
+// A value whose copies are counted, and whose copy throws when a
+// countdown reaches zero
+struct FragileValue
+{
+    FragileValue(int v) : value(v) { ++alive; }
+    FragileValue(const FragileValue& other) : value(other.value)
+    {
+        if(countdown > 0 && --countdown == 0) {
+            throw runtime_error("copy refused");
+        }
+        ++alive;
+    }
+    ~FragileValue() { --alive; }
+
+    int value;
+    static int countdown;
+    static int alive;
+};
+int FragileValue::countdown = 0;
+int FragileValue::alive = 0;
+
+// An OrderStatisticTree whose root can claim the largest count, to reach
+// the item limit without 2^32 nodes
+struct FullRankedTree : OrderStatisticTree<int,int>
+{
+    void pretendFull() { rankedRoot()->setCount(UINT32_MAX); }
+    bool stillFull() const { return rankedRoot()->getCount() == UINT32_MAX; }
+};
+
 
 int main(int argc, char *argv[])
 {
@@ -12,6 +58,9 @@ int main(int argc, char *argv[])
     BinarySearchTree<char,int> bt;
     bt.insert(std::make_pair('a',1));
     bt.insert(std::make_pair('b',2));
+    if(!bt.insert(std::make_pair('b',3)).second) {
+        cout << "b already present, value now " << bt['b'] << endl;
+    }
     
     cout << "Binary Search Tree contents:" << endl;
     for(BinarySearchTree<char,int>::iterator it = bt.begin(); it != bt.end(); ++it) {
@@ -26,6 +75,13 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     bt.remove('b');
 
+    // Sorted inserts leave a plain BST as a list
+    BinarySearchTree<int,int> lt;
+    for(int i = 0; i < 10000; ++i) {
+        lt.insert(std::make_pair(i, i));
+    }
+    cout << "Sorted BST balanced: " << lt.isBalanced() << endl;
+
     // AVL Tree Tests
     AVLTree<char,int> at;
     at.insert(std::make_pair('a',1));
@@ -43,4 +99,214 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     at.remove('b');
+
+    // AVL Tree with a plain heap allocator instead of the default node pool
+    AVLTree<int,int,HeapNodeAllocator<AVLNode<int,int> > > ht;
+    for(int i = 0; i < 100; ++i) {
+        ht.insert(std::make_pair(i, i*i));
+    }
+    for(int i = 0; i < 100; i += 2) {
+        ht.remove(i);
+    }
+    cout << "\nHeap-allocated AVLTree: 7 -> " << ht[7] << ", balanced: " << ht.isBalanced() << endl;
+
+    // AVL Tree built from a sorted range
+    std::vector<std::pair<int,int> > sorted;
+    for(int i = 0; i < 1000; ++i) {
+        sorted.push_back(std::make_pair(i, -i));
+    }
+    AVLTree<int,int> st(sorted.begin(), sorted.end());
+    cout << "Bulk-loaded AVLTree: 999 -> " << st[999] << ", balanced: " << st.isBalanced() << endl;
+
+    // Range queries
+    cout << "Keys in [10, 15):";
+    for(std::pair<const int,int>& item : st.range(10, 15)) {
+        cout << " " << item.first;
+    }
+    cout << endl;
+    cout << "lower_bound(-1): " << st.lower_bound(-1)->first
+         << ", upper_bound(998): " << st.upper_bound(998)->first
+         << ", upper_bound(999) is end: " << (st.upper_bound(999) == st.end()) << endl;
+
+    // Reverse iteration: the three largest keys
+    cout << "Last three keys:";
+    AVLTree<int,int>::const_reverse_iterator rit = st.crbegin();
+    for(int i = 0; i < 3 && rit != st.crend(); ++i, ++rit) {
+        cout << " " << rit->first;
+    }
+    cout << endl;
+
+    // Building values in place
+    AVLTree<std::string, std::vector<int> > vt;
+    vt.emplace("three", std::vector<int>(3, 3));
+    vt.try_emplace("five", 5, 5);
+    if(!vt.try_emplace("five", 1, 1).second) {
+        cout << "five kept " << vt["five"].size() << " elements" << endl;
+    }
+
+    // Order statistics: scores 0, 10, ..., 990 with every third one removed
+    OrderStatisticTree<int,int> ot;
+    for(int i = 0; i < 100; ++i) {
+        ot.insert(std::make_pair(i * 10, i));
+    }
+    for(int i = 0; i < 100; i += 3) {
+        ot.remove(i * 10);
+    }
+    cout << "\nOrderStatisticTree size: " << ot.size()
+         << ", median: " << ot.select(ot.size() / 2)->first
+         << ", rank(500): " << ot.rank(500) << endl;
+
+    // One insert past the largest count is refused and changes nothing
+    FullRankedTree full;
+    for(int i = 0; i < 10; ++i) {
+        full.insert(std::make_pair(i, i));
+    }
+    full.pretendFull();
+    bool refused = false;
+    try {
+        full.insert(std::make_pair(100, 0));
+    }
+    catch(const length_error&) {
+        refused = true;
+    }
+    cout << "Insert past the count limit refused: " << refused << ", tree unchanged: "
+         << (full.size() == 10 && full.find(100) == full.end() && full.isBalanced() && full.stillFull()) << endl;
+
+    // Threaded tree: iterators follow the in-order links
+    ThreadedAVLTree<int,int> tt(sorted.begin(), sorted.end());
+    tt.remove(500);
+    tt.insert(std::make_pair(1500, 0));
+    int count = 0;
+    for(ThreadedAVLTree<int,int>::iterator it = tt.begin(); it != tt.end(); ++it) {
+        ++count;
+    }
+    cout << "ThreadedAVLTree items: " << count << ", last: " << tt.rbegin()->first
+         << ", after 499: " << (++tt.find(499))->first << endl;
+
+    // Set operations: multiples of six are the evens that are also
+    // multiples of three; merged back in they bring their own values
+    AVLTree<int,int> evens, threes;
+    for(int i = 0; i < 100; i += 2) {
+        evens.insert(std::make_pair(i, 2));
+    }
+    for(int i = 0; i < 100; i += 3) {
+        threes.insert(std::make_pair(i, 3));
+    }
+    AVLTree<int,int> sixes;
+    sixes.merge(threes);
+    sixes.intersect(evens);
+    evens.difference(sixes);
+    cout << "\nMultiples of six: " << sixes.size() << ", other evens: " << evens.size() << endl;
+    evens.merge(sixes);
+    AVLTree<int,int> upper;
+    evens.split(50, upper);
+    cout << "Below 50: " << evens.size() << ", from 50: " << upper.size()
+         << ", evens[48] = " << evens[48] << ", balanced: " << (evens.isBalanced() && upper.isBalanced()) << endl;
+    evens.join(upper);
+    cout << "Joined: " << evens.size() << endl;
+
+    // Batched lookups: one result per key, end() for a miss
+    std::vector<int> wanted;
+    wanted.push_back(6);
+    wanted.push_back(7);
+    wanted.push_back(96);
+    std::vector<AVLTree<int,int>::iterator> found;
+    evens.find_batch(wanted, found);
+    cout << "Batch:";
+    for(size_t i = 0; i < found.size(); ++i) {
+        cout << " " << wanted[i] << (found[i] != evens.end() ? " found" : " missing");
+    }
+    cout << endl;
+
+    // Counting what the tree does: sequential inserts rotate all the way
+    AVLTree<int,int,NodePool<AVLNode<int,int> >,TreeStats> counted;
+    for(int i = 0; i < 1000; ++i) {
+        counted.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 1000; ++i) {
+        counted.find(i);
+    }
+    counted.remove(511);
+    cout << "\nStats after 1000 inserts, 1000 finds and a remove:" << endl;
+    counted.stats().dump(cout, "counted");
+
+    // The comparisons counted are the ones the key type sees
+    AVLTree<TallyKey,int,NodePool<AVLNode<TallyKey,int> >,TreeStats> tallied;
+    for(int i = 0; i < 1000; ++i) {
+        TallyKey key = { (i * 7) % 1000 };
+        tallied.insert(std::make_pair(key, i));
+    }
+    tallied.stats().reset();
+    TallyKey::tally = 0;
+    for(int i = -10; i < 1010; ++i) {
+        TallyKey key = { i };
+        tallied.find(key);
+    }
+    cout << "Comparisons counted by find match the key's own tally: "
+         << (tallied.stats().comparisons == TallyKey::tally) << endl;
+
+    // A copy that throws part way through a bulk load leaves nothing behind
+    {
+        vector<pair<int,FragileValue> > items;
+        for(int i = 0; i < 1000; ++i) {
+            items.push_back(std::make_pair(i, FragileValue(i)));
+        }
+        int before = FragileValue::alive;
+        AVLTree<int,FragileValue> pooled;
+        AVLTree<int,FragileValue,HeapNodeAllocator<AVLNode<int,FragileValue> > > heap;
+        FragileValue::countdown = 500;
+        try {
+            pooled.assign(items.begin(), items.end());
+        }
+        catch(const runtime_error&) {
+        }
+        FragileValue::countdown = 500;
+        try {
+            heap.assign(items.begin(), items.end());
+        }
+        catch(const runtime_error&) {
+        }
+        cout << "\nFailed assign leaves empty trees: "
+             << (pooled.size() == 0 && pooled.empty() && pooled.begin() == pooled.end() &&
+                 heap.size() == 0 && heap.empty() && heap.begin() == heap.end())
+             << ", no values left alive: " << (FragileValue::alive == before) << endl;
+
+        // Count the copies a batch takes, to fail 500 items into its build
+        FragileValue::countdown = 1000000;
+        {
+            AVLTree<int,FragileValue> scratch;
+            scratch.insert_batch(items.begin(), items.end(), 1);
+        }
+        int copies = 1000000 - FragileValue::countdown;
+        AVLTree<int,FragileValue> batched;
+        batched.insert(std::make_pair(-1, FragileValue(-1)));
+        before = FragileValue::alive;
+        FragileValue::countdown = copies - 500;
+        try {
+            batched.insert_batch(items.begin(), items.end(), 1);
+        }
+        catch(const runtime_error&) {
+        }
+        FragileValue::countdown = 0;
+        cout << "Failed insert_batch leaves the tree as it was: "
+             << (batched.size() == 1 && batched.begin()->first == -1 && batched.isBalanced())
+             << ", no values left alive: " << (FragileValue::alive == before) << endl;
+    }
+
+    // String keys looked up by const char*, without building a std::string
+    AVLTree<std::string,int> names;
+    names.insert(std::make_pair(std::string("alice"), 1));
+    names.insert(std::make_pair(std::string("bob"), 2));
+    names.insert(std::make_pair(std::string("carol"), 3));
+    names.insert(std::make_pair(std::string("dave"), 4));
+    const char* who = "carol";
+    cout << "\ncarol -> " << names.find(who)->second << ", bob -> " << names["bob"]
+         << ", bo " << (names.find("bo") == names.end() ? "missing" : "found") << endl;
+    names.remove("alice");
+    names.remove("zed");
+    cout << "After removing alice:";
+    for(AVLTree<std::string,int>::iterator it = names.begin(); it != names.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << ", balanced: " << names.isBalanced() << endl;
 }
@@ -5,20 +5,40 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include "node_pool.h"
+#include "tree_stats.h"
+
+// Hints that the memory at addr will be read soon. A no-op on compilers
+// without the builtin.
+#if defined(__GNUC__)
+#define BST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BST_PREFETCH(addr) ((void)0)
+#endif
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual, so a node is just its item and
+ * three links. Derived node types for other kinds of search
+ * trees (e.g. AVL trees) hide the getters for parent/left/right
+ * with versions returning their own type; the tree that owns the
+ * nodes always knows their concrete type, so the calls resolve
+ * at compile time.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    template<typename... Args>
+    Node(Node<Key, Value>* parent, Args&&... args);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,15 +46,19 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+    // Node types that link each node to its in-order neighbours hide
+    // this with true, and the tree's iterators then follow those links.
+    static const bool threaded = false;
+
 protected:
     std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
@@ -61,6 +85,21 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that builds the item in place from args, which are
+* forwarded to the std::pair constructor.
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+Node<Key, Value>::Node(Node<Key, Value>* parent, Args&&... args) :
+    item_(std::forward<Args>(args)...),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -118,7 +157,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -127,7 +166,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +175,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -186,31 +225,136 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* Whether find, operator[] and remove also accept keys of other types,
+* compared against the stored keys directly with ==, < and > instead of
+* being converted to Key first. A Key type opts in by specialising this
+* to declare is_transparent, like the standard's transparent comparators.
+* It may also give a static probe(k) turning a lookup key into something
+* cheaper to compare, done once per lookup.
+*
+* std::string opts in, so a tree of strings can be searched with a const
+* char* (or, in C++17, a std::string_view) without allocating a string
+* for each lookup. A C string is measured once up front, rather than by
+* every comparison on the way down.
+*/
+template<typename Key>
+struct KeyLookup
+{
+};
+
+/**
+* A C string and its length, compared with basic_strings as one would be.
+*/
+template<typename CharT, typename Traits>
+struct StringProbe
+{
+    const CharT* data;
+    std::size_t size;
+
+    template<typename Allocator>
+    int compare(const std::basic_string<CharT, Traits, Allocator>& key) const
+    {
+        int result = Traits::compare(data, key.data(), std::min(size, key.size()));
+        if(result != 0) {
+            return result;
+        }
+        return (size < key.size()) ? -1 : (size > key.size()) ? 1 : 0;
+    }
+
+    template<typename Allocator>
+    friend bool operator==(const StringProbe& probe, const std::basic_string<CharT, Traits, Allocator>& key)
+    {
+        return probe.size == key.size() && Traits::compare(probe.data, key.data(), probe.size) == 0;
+    }
+    template<typename Allocator>
+    friend bool operator<(const StringProbe& probe, const std::basic_string<CharT, Traits, Allocator>& key)
+    {
+        return probe.compare(key) < 0;
+    }
+    template<typename Allocator>
+    friend bool operator>(const StringProbe& probe, const std::basic_string<CharT, Traits, Allocator>& key)
+    {
+        return probe.compare(key) > 0;
+    }
+};
+
+template<typename CharT, typename Traits, typename Allocator>
+struct KeyLookup<std::basic_string<CharT, Traits, Allocator> >
+{
+    typedef void is_transparent;
+
+    static StringProbe<CharT, Traits> probe(const CharT* key)
+    {
+        StringProbe<CharT, Traits> result = { key, Traits::length(key) };
+        return result;
+    }
+};
+
+// Lookup::probe(key) if Lookup has one that takes key, else key itself
+template<typename Lookup, typename K>
+auto lookupProbe(const K& key, int) -> decltype(Lookup::probe(key))
+{
+    return Lookup::probe(key);
+}
+
+template<typename Lookup, typename K>
+const K& lookupProbe(const K& key, long)
+{
+    return key;
+}
+
 /**
 * A templated unbalanced binary search tree.
+* Nodes are created and destroyed through Alloc (see node_pool.h); by
+* default each tree owns a NodePool arena.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Alloc = NodePool<Node<Key, Value> >, typename Stats = NoTreeStats>
 class BinarySearchTree
 {
 public:
+    class iterator;
+    class const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
     BinarySearchTree(); //TODO
-    virtual ~BinarySearchTree(); //TODO
-    virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
+    virtual ~BinarySearchTree();
+    virtual std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    std::pair<iterator, bool> insert(std::pair<const Key, Value>&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    template<typename K, typename Lookup = KeyLookup<Key>, typename = typename Lookup::is_transparent>
+    void remove(const K& key);
+    void clear();
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    std::size_t size() const;
+    Stats& stats() const;
 
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PPKey, typename PPValue, typename PPAlloc, typename PPStats>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPAlloc, PPStats> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * Bidirectional: -- steps to the predecessor, and --end() is the
+    * largest item, which is why the iterator remembers its tree.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -220,38 +364,134 @@ public:
         bool operator!=(const iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Alloc, Stats>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Alloc, Stats>* tree);
         Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Alloc, Stats>* tree_;
+    };
+
+    /**
+    * An iterator that only gives const access to the items. Any iterator
+    * converts to one, and the two can be compared with each other.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.it_ == rhs.it_; }
+        friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return lhs.it_ != rhs.it_; }
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        iterator it_;
     };
 
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    template<typename K, typename Lookup = KeyLookup<Key>, typename = typename Lookup::is_transparent>
+    iterator find(const K& key) const;
+    void find_batch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
+    template<typename K, typename Lookup = KeyLookup<Key>, typename = typename Lookup::is_transparent>
+    Value& operator[](const K& key);
+    template<typename K, typename Lookup = KeyLookup<Key>, typename = typename Lookup::is_transparent>
+    Value const & operator[](const K& key) const;
+
+    /**
+    * The items with lo <= key < hi, as returned by range(). Only holds
+    * the two boundary iterators; items are visited lazily by iterating.
+    */
+    class Range
+    {
+    public:
+        Range(iterator first, iterator last) : first_(first), last_(last) {}
+        iterator begin() const { return first_; }
+        iterator end() const { return last_; }
+        bool empty() const { return first_ == last_; }
+
+    private:
+        iterator first_;
+        iterator last_;
+    };
+
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
 
 protected:
+    typedef typename Alloc::node_type NodeType;
+
+    // Descents find_batch() keeps in flight at once
+    static const std::size_t FIND_BATCH_GROUP = 16;
+
     // Mandatory helper functions
-    Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K>
+    Node<Key, Value>* internalFind(const K& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
-    virtual void printRoot (Node<Key, Value> *r) const;
+    void printRoot (Node<Key, Value> *r) const;
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
+    virtual void eraseNode(Node<Key, Value>* node);
 
     // Add helper functions here
     static Node<Key, Value>* successor(Node<Key, Value>* current);
+    static Node<Key, Value>* nextInOrder(Node<Key, Value>* current);
+    static Node<Key, Value>* prevInOrder(Node<Key, Value>* current);
+    static Node<Key, Value>* nextInOrder(NodeType* current, std::false_type);
+    static Node<Key, Value>* nextInOrder(NodeType* current, std::true_type);
+    static Node<Key, Value>* prevInOrder(NodeType* current, std::false_type);
+    static Node<Key, Value>* prevInOrder(NodeType* current, std::true_type);
+    template<typename... Args>
+    NodeType* createNode(Node<Key, Value>* parent, Args&&... args);
+    void destroyNode(Node<Key, Value>* node);
+    void destroySubtree(Node<Key, Value>* root);
+    Node<Key, Value>* findInsertPoint(const Key& key, Node<Key, Value>*& parent, bool& isLeft) const;
+    void linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft);
+    virtual void insertRebalance(Node<Key, Value>* node);
+    int heightIfBalanced() const;
+    virtual bool nodeBalanced(Node<Key, Value>* node, int leftHeight, int rightHeight) const;
+    iterator iteratorAt(Node<Key, Value>* node) const;
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    std::size_t size_;          // live nodes, counted by createNode/destroyNode
+    Alloc alloc_;
+    mutable Stats stats_;       // see tree_stats.h; counted by const lookups too
 };
 
 /*
@@ -263,29 +503,31 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Alloc, Stats>* tree)
 {
   // TODO
 	this->current_ = ptr;
+	this->tree_ = tree;
 }
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::iterator() 
 {
   // TODO
 	this->current_ = nullptr;
+	this->tree_ = nullptr;
 }
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc, class Stats>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator*() const
 {
   return current_->getItem();
 }
@@ -293,9 +535,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc, class Stats>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -304,10 +546,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc, class Stats>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Alloc, Stats>::iterator& rhs) const
 {
     // TODO
     return (current_ == rhs.current_);
@@ -317,10 +559,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc, class Stats>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Alloc, Stats>::iterator& rhs) const
 {
     // TODO
     return (current_ != rhs.current_);
@@ -331,15 +573,50 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator&
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator++()
 {
     // TODO
-    current_ = successor(current_);
+    current_ = nextInOrder(current_);
+    return *this;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator++(int)
+{
+    iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+/**
+* Moves the iterator back to the previous item in order. Decrementing
+* end() gives the largest item.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator&
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator--()
+{
+    if(current_ == nullptr) {
+        current_ = tree_->getLargestNode();
+    }
+    else {
+        current_ = prevInOrder(current_);
+    }
     return *this;
 }
 
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::iterator::operator--(int)
+{
+    iterator old = *this;
+    --(*this);
+    return old;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -347,6 +624,82 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::const_iterator()
+{
+
+}
+
+/**
+* Converts a mutable iterator to a const one at the same position.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
+{
+
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator&
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator++(int)
+{
+    const_iterator old = *this;
+    ++it_;
+    return old;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator&
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator::operator--(int)
+{
+    const_iterator old = *this;
+    --it_;
+    return old;
+}
+
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -356,31 +709,50 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Alloc, class Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::BinarySearchTree() 
 {
     // TODO
     this->root_ = nullptr;
+    this->size_ = 0;
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template<typename Key, typename Value, typename Alloc, typename Stats>
+BinarySearchTree<Key, Value, Alloc, Stats>::~BinarySearchTree()
 {
-    // TODO
     this->clear();
 }
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Alloc, class Stats>
+bool BinarySearchTree<Key, Value, Alloc, Stats>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+ * Returns the number of items in the tree, in O(1).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+std::size_t BinarySearchTree<Key, Value, Alloc, Stats>::size() const
+{
+    return size_;
+}
+
+/**
+* The tree's stats policy: with TreeStats, its counters (see
+* tree_stats.h).
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+Stats& BinarySearchTree<Key, Value, Alloc, Stats>::stats() const
+{
+    return stats_;
+}
+
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -389,130 +761,376 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Alloc, Stats>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Alloc, Stats>::iterator end(NULL, this);
     return end;
 }
 
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::cbegin() const
+{
+    return const_iterator(begin());
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::cend() const
+{
+    return const_iterator(end());
+}
+
+/**
+* Reverse iteration starts at the largest item. Each step is a
+* predecessor() call, so walking the last N items costs O(log n + N).
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::find(const Key & k) const
 {
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Alloc, Stats>::iterator it(curr, this);
     return it;
 }
 
+/**
+* find() for a key of another type, such as a const char* in a tree of
+* strings. Only when KeyLookup<Key> is transparent.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename K, typename Lookup, typename>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::find(const K& k) const
+{
+    return iterator(internalFind(lookupProbe<Lookup>(k, 0)), this);
+}
+
+/**
+* Looks up every key in keys, setting out[i] to find(keys[i]).
+*
+* A single find() spends most of its time waiting for each node on the
+* path to arrive from memory, and cannot ask for the next one before it
+* has compared against this one. Here up to FIND_BATCH_GROUP descents
+* advance in turn, one level each, prefetching the next node of each as
+* they go (AMAC style), so that many cache misses are in flight at once.
+* A descent that finishes is replaced by the next key at once.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::find_batch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.assign(keys.size(), end());
+
+    Node<Key, Value>* cursor[FIND_BATCH_GROUP];
+    std::size_t slot[FIND_BATCH_GROUP];
+    std::size_t active = 0;
+    std::size_t next = 0;
+    while(active < FIND_BATCH_GROUP && next < keys.size()) {
+        cursor[active] = root_;
+        slot[active++] = next++;
+    }
+
+    while(active > 0) {
+        for(std::size_t i = 0; i < active; ) {
+            Node<Key, Value>* node = cursor[i];
+            const Key& key = keys[slot[i]];
+
+            if(node != nullptr && !(key == node->getKey())) { //Go down one level
+                node = (key < node->getKey()) ? node->getLeft() : node->getRight();
+                BST_PREFETCH(node);
+                cursor[i++] = node;
+                continue;
+            }
+
+            if(node != nullptr) { //Found; a miss keeps the end() set above
+                out[slot[i]] = iteratorAt(node);
+            }
+            if(next < keys.size()) { //Start the next key in this slot
+                cursor[i] = root_;
+                slot[i++] = next++;
+            }
+            else { //Nothing left to start: move the last descent here
+                --active;
+                cursor[i] = cursor[active];
+                slot[i] = slot[active];
+            }
+        }
+    }
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none. One descent, comparing with < only.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::lower_bound(const Key& key) const
+{
+    Node<Key, Value>* itr = root_;
+    Node<Key, Value>* candidate = nullptr;
+    while(itr != nullptr) {
+        if(itr->getKey() < key) {
+            itr = itr->getRight();
+        }
+        else { //itr qualifies, look for a smaller one on the left
+            candidate = itr;
+            itr = itr->getLeft();
+        }
+    }
+    return iterator(candidate, this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::upper_bound(const Key& key) const
+{
+    Node<Key, Value>* itr = root_;
+    Node<Key, Value>* candidate = nullptr;
+    while(itr != nullptr) {
+        if(key < itr->getKey()) { //itr qualifies, look for a smaller one on the left
+            candidate = itr;
+            itr = itr->getLeft();
+        }
+        else {
+            itr = itr->getRight();
+        }
+    }
+    return iterator(candidate, this);
+}
+
+/**
+* Returns [lower_bound(key), upper_bound(key)): the item with the given
+* key, if any. Keys are unique, so the second iterator is found by
+* stepping once instead of a second descent.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator,
+          typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator>
+BinarySearchTree<Key, Value, Alloc, Stats>::equal_range(const Key& key) const
+{
+    iterator first = lower_bound(key);
+    iterator last = first;
+    if(last != end() && !(key < last->first)) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Returns the items with lo <= key < hi, in order. Finding the bounds
+* costs two descents; iterating the range then only touches the items
+* in it. Empty if hi <= lo.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::Range
+BinarySearchTree<Key, Value, Alloc, Stats>::range(const Key& lo, const Key& hi) const
+{
+    if(!(lo < hi)) {
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Alloc, class Stats>
+Value& BinarySearchTree<Key, Value, Alloc, Stats>::operator[](const Key& key)
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Alloc, class Stats>
+Value const & BinarySearchTree<Key, Value, Alloc, Stats>::operator[](const Key& key) const
 {
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
+template<class Key, class Value, class Alloc, class Stats>
+template<typename K, typename Lookup, typename>
+Value& BinarySearchTree<Key, Value, Alloc, Stats>::operator[](const K& key)
+{
+    Node<Key, Value> *curr = internalFind(lookupProbe<Lookup>(key, 0));
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Alloc, class Stats>
+template<typename K, typename Lookup, typename>
+Value const & BinarySearchTree<Key, Value, Alloc, Stats>::operator[](const K& key) const
+{
+    Node<Key, Value> *curr = internalFind(lookupProbe<Lookup>(key, 0));
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
 
 /**
 * An insert method to insert into a Binary Search Tree.
 * The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* If the key is already in the tree, its value is overwritten.
+* Walks the tree once, either finding the key or the node to attach to.
+* Returns an iterator to the item and true if a new node was created,
+* false if an existing value was overwritten.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Alloc, class Stats>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Stats>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-    // TODO
-		if(this->root_ == nullptr) { //Root_ doesn't exist, create a new root
-			Node<Key, Value>* newRoot = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-			this->root_ = newRoot;
-			return;
-		}
-		
-		Node<Key, Value>* findNode = internalFind(keyValuePair.first); //First, check to see if node already exists
-		if(findNode != nullptr) {
-			findNode->setValue(keyValuePair.second);
-			return;
-		}
-		
-		else { //Walk tree to find where to insert new node
-			delete findNode;
-			Node<Key, Value>* itr = this->root_;
-			Node<Key,Value>* itrParent = this->root_; //Keep track of parent in case itr becomes null
-
-			if(keyValuePair.first < itr->getKey()) { //Check if the key is smaller than itr's key
-				if(this->root_->getLeft() != nullptr) { //If root_ contains a left child, search through left subtree
-					itr = this->root_->getLeft();
-				}
-				
-				while(itr != nullptr) { //Search through the subtree until itr becomes nullptr
-					if(keyValuePair.first < itr->getKey()) { //If key is smaller than itr, continue searching through left subtree
-						itrParent = itr;
-						itr = itr->getLeft();
-					}
-					else if(keyValuePair.first > itr->getKey()) { //If key is greater than itr, continue searching through right subtree
-						itrParent = itr;
-						itr = itr->getRight();
-					}
-				}
-			}
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = findInsertPoint(keyValuePair.first, parent, isLeft);
+    if(existing != nullptr) {
+        existing->setValue(keyValuePair.second);
+        return std::make_pair(iterator(existing, this), false);
+    }
 
-			else if(keyValuePair.first > itr->getKey()) { //Check if the key is greater than itr's key
-				if(this->root_->getRight() != nullptr) { //If root_ contains a left child, search through left subtree
-					itr = this->root_->getRight();
-				}
-
-				while(itr != nullptr) { //Search through the subtree until itr becomes nullptr
-					if(keyValuePair.first < itr->getKey()) { //If key is smaller than itr, continue searching through left subtree
-						itrParent = itr;
-						itr = itr->getLeft();
-					}
-
-					else if(keyValuePair.first > itr->getKey()) { //If key is greater than itr, continue searching through right subtree
-						itrParent = itr;
-						itr = itr->getRight();
-					}
-				}
-			}
+    Node<Key, Value>* newNode = createNode(parent, keyValuePair);
+    linkNode(newNode, parent, isLeft);
+    return std::make_pair(iterator(newNode, this), true);
+}
 
-			Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, itrParent);
-			//This is where we create the new node based on where itr became null and where itrParent left off.
-			if(keyValuePair.first < itrParent->getKey()) { //If key is less than itrParent, then set the new node as itrParent's left child
-				itrParent->setLeft(newNode);
-			}
-			else if(keyValuePair.first > itrParent->getKey()) { //If key is greater than itrParent, then set the new node as itrParent's right child
-				itrParent->setRight(newNode);
-			}
-		}
+/**
+* Same as above, but moves the value (and the key, where it is movable)
+* into the tree instead of copying it.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Stats>::insert(std::pair<const Key, Value> &&keyValuePair)
+{
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = findInsertPoint(keyValuePair.first, parent, isLeft);
+    if(existing != nullptr) {
+        existing->getValue() = std::move(keyValuePair.second);
+        return std::make_pair(iterator(existing, this), false);
+    }
 
-		return;
+    Node<Key, Value>* newNode = createNode(parent, std::move(keyValuePair));
+    linkNode(newNode, parent, isLeft);
+    return std::make_pair(iterator(newNode, this), true);
+}
+
+/**
+* Constructs the item in place inside a new node from args (anything the
+* std::pair constructor accepts). As with insert, if the key is already
+* in the tree its value is overwritten, here by moving the newly built
+* value into it; the spare node is then released.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Stats>::emplace(Args&&... args)
+{
+    Node<Key, Value>* newNode = createNode(nullptr, std::forward<Args>(args)...);
+
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = findInsertPoint(newNode->getKey(), parent, isLeft);
+    if(existing != nullptr) {
+        existing->getValue() = std::move(newNode->getValue());
+        destroyNode(newNode);
+        return std::make_pair(iterator(existing, this), false);
+    }
+
+    newNode->setParent(parent);
+    linkNode(newNode, parent, isLeft);
+    return std::make_pair(iterator(newNode, this), true);
+}
+
+/**
+* If key is not in the tree, inserts it with a value constructed in place
+* from args. If it is, nothing is constructed, moved or overwritten.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Stats>::try_emplace(const Key& key, Args&&... args)
+{
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = findInsertPoint(key, parent, isLeft);
+    if(existing != nullptr) {
+        return std::make_pair(iterator(existing, this), false);
+    }
+
+    Node<Key, Value>* newNode = createNode(parent, std::piecewise_construct,
+                                           std::forward_as_tuple(key),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+    linkNode(newNode, parent, isLeft);
+    return std::make_pair(iterator(newNode, this), true);
+}
+
+/**
+* Same as above, but moves key into the tree.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator, bool>
+BinarySearchTree<Key, Value, Alloc, Stats>::try_emplace(Key&& key, Args&&... args)
+{
+    Node<Key, Value>* parent;
+    bool isLeft;
+    Node<Key, Value>* existing = findInsertPoint(key, parent, isLeft);
+    if(existing != nullptr) {
+        return std::make_pair(iterator(existing, this), false);
+    }
+
+    Node<Key, Value>* newNode = createNode(parent, std::piecewise_construct,
+                                           std::forward_as_tuple(std::move(key)),
+                                           std::forward_as_tuple(std::forward<Args>(args)...));
+    linkNode(newNode, parent, isLeft);
+    return std::make_pair(iterator(newNode, this), true);
 }
 
 
@@ -521,8 +1139,8 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::remove(const Key& key)
 {
 
   Node<Key, Value>* itr = internalFind(key); //Search through tree to find key to be removed
@@ -531,9 +1149,33 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 		return;
 	}
 
+	eraseNode(itr);
+}
+
+/**
+* remove() for a key of another type. Only when KeyLookup<Key> is
+* transparent.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+template<typename K, typename Lookup, typename>
+void BinarySearchTree<Key, Value, Alloc, Stats>::remove(const K& key)
+{
+	Node<Key, Value>* itr = internalFind(lookupProbe<Lookup>(key, 0));
+	if(itr != nullptr) {
+		eraseNode(itr);
+	}
+}
+
+/**
+* Unlinks and frees a node of this tree. Derived trees override this
+* to rebalance.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::eraseNode(Node<Key, Value>* itr)
+{
 	if(itr == this->root_) { //If the Key being removed is the root
 		if(itr->getLeft() == nullptr && itr->getRight() == nullptr) { //If the root contains no children, then just delete it and set root_ to nullptr
-			delete itr;
+			destroyNode(itr);
 			this->root_ = nullptr;
 			return;
 		}
@@ -554,12 +1196,12 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 	if(itr->getLeft() == nullptr && itr->getRight() == nullptr) { //Node is a leaf node and has 0 children
 		if(itr->getParent()->getLeft() == itr) { //Node is left child of parent
 			itr->getParent()->setLeft(nullptr); //Set parent's left node to null and then delete the left node
-			delete itr;
+			destroyNode(itr);
 			return;
 		}
 		else if(itr->getParent()->getRight() == itr) { //Node is right child of parent
 			itr->getParent()->setRight(nullptr); //Set parent's right node to null and then delete the right node
-			delete itr;
+			destroyNode(itr);
 			return;
 		}
 	}
@@ -571,12 +1213,12 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 			if(itr->getLeft() == nullptr) { //If itr's left node is nullptr then it only contains a right child
 				itr->getRight()->setParent(nullptr);
 				this->root_ = itr->getRight();
-				delete itr;
+				destroyNode(itr);
 			}
 			else if(itr->getRight() == nullptr) { //If itr's right node is nullptr then it only contains a left child
 				itr->getLeft()->setParent(nullptr);
 				this->root_ = itr->getLeft();
-				delete itr;
+				destroyNode(itr);
 			}
 		}
 
@@ -589,6 +1231,7 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 				itrParent->setLeft(itr->getLeft());
 				itr->getLeft()->setParent(itrParent);
 			}
+			destroyNode(itr);
 		}
 
 		else if(itr->getParent()->getRight() == itr) { //Node is right child of parent
@@ -600,132 +1243,301 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
 				itrParent->setRight(itr->getLeft());
 				itr->getLeft()->setParent(itrParent);
 			}
+			destroyNode(itr);
 		}
 	}
 }
 
 
 
-template<class Key, class Value>
+/**
+* Returns the node that comes right before current in an in-order
+* traversal, or NULL if current holds the smallest key.
+*/
+template<class Key, class Value, class Alloc, class Stats>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Alloc, Stats>::predecessor(Node<Key, Value>* current)
 {
-    // TODO
     Node<Key, Value>* itr = current;
 
-		if(current->getLeft() == nullptr && current->getRight() == nullptr) { //If itr contains no children, return
-			return nullptr;
-		}
+    if(itr->getLeft() != nullptr) { //Rightmost node of the left subtree
+        itr = itr->getLeft();
+        while(itr->getRight() != nullptr) {
+            itr = itr->getRight();
+        }
+        return itr;
+    }
 
-    if(itr->getLeft() != nullptr) { //Make sure that the current node has a left subtree
-			itr = current->getLeft();
-			if(itr->getRight() != nullptr){
-				while(itr->getRight() != nullptr) {
-					itr = itr->getRight();
-				}
-			}
-			return itr;
+    //Otherwise climb until we come up from a right child
+    Node<Key, Value>* itrParent = itr->getParent();
+    while(itrParent != nullptr && itr == itrParent->getLeft()) {
+        itr = itrParent;
+        itrParent = itr->getParent();
     }
+    return itrParent;
+}
 
-		else if(itr->getLeft() == nullptr) { //Otherwise search up parent
-			Node<Key, Value>* itrParent;
-			while(itr->getParent() != nullptr) {
-				itrParent = itr->getParent();
-				if(itr == itrParent->getRight()) {
-					return itrParent;
-				}
-				itr = itr->getParent();
-			}
+/**
+* Returns the node that comes right after current in an in-order
+* traversal, or NULL if current holds the largest key.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Alloc, Stats>::successor(Node<Key, Value>* current)
+{
+    Node<Key, Value>* itr = current;
 
-			return nullptr;
-		}
+    if(itr->getRight() != nullptr) { //Leftmost node of the right subtree
+        itr = itr->getRight();
+        while(itr->getLeft() != nullptr) {
+            itr = itr->getLeft();
+        }
+        return itr;
+    }
+
+    //Otherwise climb until we come up from a left child
+    Node<Key, Value>* itrParent = itr->getParent();
+    while(itrParent != nullptr && itr == itrParent->getRight()) {
+        itr = itrParent;
+        itrParent = itr->getParent();
+    }
+    return itrParent;
+}
 
-		return itr;
 
+/**
+* Allocates a node through the tree's allocator and constructs its item
+* in place from args.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+template<typename... Args>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::NodeType*
+BinarySearchTree<Key, Value, Alloc, Stats>::createNode(Node<Key, Value>* parent, Args&&... args)
+{
+    NodeType* node = alloc_.create(static_cast<NodeType*>(parent), std::forward<Args>(args)...);
+    ++size_;
+    return node;
 }
 
-template<class Key, class Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
-{   
-    Node<Key, Value>* itr = current;
+/**
+* Returns a node created by createNode() to the tree's allocator.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::destroyNode(Node<Key, Value>* node)
+{
+    alloc_.destroy(static_cast<NodeType*>(node));
+    --size_;
+}
 
-		if(current->getLeft() == nullptr && current->getRight() == nullptr) {
-			return nullptr;
-		}
-    
-    if(current->getRight() != nullptr) { //Make sure that the current node has a right subtree
-			itr = current->getRight();
-			if(itr->getLeft() != nullptr) {
-				while(itr->getLeft() != nullptr) {
-						itr = itr->getLeft();
-				}
-			}
-			return itr;		
-    }
-
-		else if(itr->getRight() == nullptr) { //Otherwise search up parent
-			itr = current;
-			Node<Key, Value>* itrParent;
-			while(itr->getParent() != nullptr) {
-				itrParent = itr->getParent();
-				if(itr == itrParent->getLeft()) {
-					return itrParent;
-				}
-				itr = itr->getParent();
-			}
-		}
+/**
+* Single descent for insertion. Returns the node holding key if there is
+* one. Otherwise returns NULL and sets parent to the node a new key would
+* hang from (NULL for an empty tree) and isLeft to the side it goes on.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::findInsertPoint(
+    const Key& key, Node<Key, Value>*& parent, bool& isLeft) const
+{
+    Node<Key, Value>* itr = this->root_;
+    parent = nullptr;
+    isLeft = false;
+
+    while(itr != nullptr) {
+        if(key < itr->getKey()) {
+            parent = itr;
+            isLeft = true;
+            itr = itr->getLeft();
+        }
+        else if(itr->getKey() < key) {
+            parent = itr;
+            isLeft = false;
+            itr = itr->getRight();
+        }
+        else {
+            return itr;
+        }
+    }
+    return nullptr;
+}
+
+/**
+* Hangs a freshly created node at the spot found by findInsertPoint()
+* and lets the tree rebalance around it.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::linkNode(Node<Key, Value>* node, Node<Key, Value>* parent, bool isLeft)
+{
+    if(parent == nullptr) {
+        this->root_ = node;
+    }
+    else if(isLeft) {
+        parent->setLeft(node);
+    }
+    else {
+        parent->setRight(node);
+    }
+    insertRebalance(node);
+}
+
+/**
+* Lets derived trees hand out iterators to their own nodes.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+typename BinarySearchTree<Key, Value, Alloc, Stats>::iterator
+BinarySearchTree<Key, Value, Alloc, Stats>::iteratorAt(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* The in-order step used by iterators: successor() for ordinary nodes,
+* or a single hop along the thread for threaded nodes. Chosen at compile
+* time from NodeType::threaded.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::nextInOrder(Node<Key, Value>* current)
+{
+    return nextInOrder(static_cast<NodeType*>(current), std::integral_constant<bool, NodeType::threaded>());
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::prevInOrder(Node<Key, Value>* current)
+{
+    return prevInOrder(static_cast<NodeType*>(current), std::integral_constant<bool, NodeType::threaded>());
+}
 
-		return itr;
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::nextInOrder(NodeType* current, std::false_type)
+{
+    return successor(current);
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::nextInOrder(NodeType* current, std::true_type)
+{
+    return current->getNext();
+}
+
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::prevInOrder(NodeType* current, std::false_type)
+{
+    return predecessor(current);
 }
 
+template<class Key, class Value, class Alloc, class Stats>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::prevInOrder(NodeType* current, std::true_type)
+{
+    return current->getPrev();
+}
+
+/**
+* Called after a new node has been linked into the tree. A plain
+* BinarySearchTree does not rebalance; balanced trees override this.
+*/
+template<class Key, class Value, class Alloc, class Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::insertRebalance(Node<Key, Value>* node)
+{
+
+}
 
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
+* Frees every node in a single post-order walk: no searching,
+* swapping or rebalancing, and no stack since the walk climbs
+* back up through parent pointers.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::clear()
 {
-    // TODO
-		while(this->root_ != nullptr) { //Keep removing the root until tree is empty
-			remove(this->root_->getKey());
-		}
-
+    Node<Key, Value>* oldRoot = this->root_;
+    this->root_ = nullptr;
+    destroySubtree(oldRoot);
+    this->size_ = 0;
+}
 
+/**
+* Frees every node below and including root, which must already be
+* detached from the tree, in a single post-order walk.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::destroySubtree(Node<Key, Value>* root)
+{
+    if(root == nullptr) {
+        return;
+    }
+    Node<Key, Value>* top = root->getParent();
+    Node<Key, Value>* itr = root;
+
+    while(itr != top) {
+        if(itr->getLeft() != nullptr) { //Descend until we reach a leaf
+            itr = itr->getLeft();
+        }
+        else if(itr->getRight() != nullptr) {
+            itr = itr->getRight();
+        }
+        else { //Leaf: unhook it from its parent, free it and continue from the parent
+            Node<Key, Value>* itrParent = itr->getParent();
+            if(itrParent != top) {
+                if(itrParent->getLeft() == itr) {
+                    itrParent->setLeft(nullptr);
+                }
+                else {
+                    itrParent->setRight(nullptr);
+                }
+            }
+            destroyNode(itr);
+            itr = itrParent;
+        }
+    }
 }
 
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Alloc, typename Stats>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Alloc, Stats>::getSmallestNode() const
 {
-    // TODO
-		Node<Key, Value>* itr = this->root_;
-		Node<Key,Value>* parent = this->root_; 
+    Node<Key, Value>* itr = this->root_;
 
-		while(itr != nullptr) { //Keep searching through left subtree to find smallest node
-			if(itr->getLeft() != nullptr) { //As long as the left node isn't NULL, change parent to current node
-				parent = itr;
-			}
-			itr = itr->getLeft();
-		}
-
-		return parent;
+    if(itr == nullptr) {
+        return nullptr;
+    }
+    while(itr->getLeft() != nullptr) { //Keep following left children to find the smallest node
+        itr = itr->getLeft();
+    }
+    return itr;
+}
 
+/**
+* A helper function to find the largest node in the tree.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Alloc, Stats>::getLargestNode() const
+{
+    Node<Key, Value>* itr = this->root_;
 
+    if(itr == nullptr) {
+        return nullptr;
+    }
+    while(itr->getRight() != nullptr) { //Keep following right children to find the largest node
+        itr = itr->getRight();
+    }
+    return itr;
 }
 
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
-* exists
+* exists. k is a Key, or for the transparent lookups anything
+* that compares with one.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Alloc, typename Stats>
+template<typename K>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc, Stats>::internalFind(const K& key) const
 {
 	Node<Key, Value>* itr = this->root_;
 
@@ -734,19 +1546,33 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 	}
 
 	else {
+		//Counted locally and handed to the stats policy once, so that
+		//counting does not get in the way of the descent. Each ==, < and >
+		//is counted just before it is made
+		std::size_t depth = 0;
+		unsigned comparisons = 0;
 		while(itr != nullptr) {
+			++depth;
+			++comparisons;
 			if(key == itr->getKey()) { //If node has been found, return the node
+				stats_.compared(comparisons);
+				stats_.descended(depth);
 				return itr;
 			}
 
-			else if(key < itr->getKey()) { //If the node key is less than the iterator's key, search through left subtree
+			++comparisons;
+			if(key < itr->getKey()) { //If the node key is less than the iterator's key, search through left subtree
 				itr = itr->getLeft();
+				continue;
 			}
 
-			else if(key > itr->getKey()) { //If the node key is greater than the iterator's key, search through right subtree
+			++comparisons;
+			if(key > itr->getKey()) { //If the node key is greater than the iterator's key, search through right subtree
 				itr = itr->getRight();
 			}
 		}
+		stats_.compared(comparisons);
+		stats_.descended(depth);
 	}
 
 	return itr;
@@ -755,54 +1581,80 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-int calculateHeightIfBalanced(Node<Key,Value>* root) {
-	if (root == nullptr) {
-		return 0;
-	}
-		
-	int left = calculateHeightIfBalanced(root->getLeft());
-	int right = calculateHeightIfBalanced(root->getRight());
-
-	if(left > right) {
-		return 1 + left;
-	}
-
-	else {
-		return 1 + right;
-	}
-
+template<typename Key, typename Value, typename Alloc, typename Stats>
+bool BinarySearchTree<Key, Value, Alloc, Stats>::isBalanced() const
+{
+	return heightIfBalanced() >= 0;
 }
 
-template<typename Key, typename Value>
-bool checkIfBalanced(Node<Key,Value>* root) {
-	if(root == nullptr) { //Base case
-		return true;
+/**
+* Returns the height of the tree, or -1 as soon as nodeBalanced() rejects
+* a node. Heights are computed bottom-up in a single post-order walk over
+* the parent pointers, so every node is visited once and a degenerate tree
+* cannot overflow the call stack.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+int BinarySearchTree<Key, Value, Alloc, Stats>::heightIfBalanced() const
+{
+	if(root_ == nullptr) {
+		return 0;
 	}
 
-	int leftHeight = calculateHeightIfBalanced(root->getLeft());
-	int rightHeight = calculateHeightIfBalanced(root->getRight());
+	std::vector<int> heights; //Heights of finished subtrees, left pushed before right
+	Node<Key, Value>* curr = root_;
+	int phase = 0; //0: just arrived, 1: left subtree done, 2: both subtrees done
+	while(true) {
+		if(phase == 0) {
+			if(curr->getLeft() != nullptr) {
+				curr = curr->getLeft();
+				continue;
+			}
+			heights.push_back(0);
+			phase = 1;
+		}
+		if(phase == 1) {
+			if(curr->getRight() != nullptr) {
+				curr = curr->getRight();
+				phase = 0;
+				continue;
+			}
+			heights.push_back(0);
+		}
 
-	if(abs(leftHeight - rightHeight) <= 1 && checkIfBalanced(root->getRight()) && checkIfBalanced(root->getLeft())) {
-		return true;
-	}
+		int rightHeight = heights.back();
+		heights.pop_back();
+		int leftHeight = heights.back();
+		heights.pop_back();
+		if(!nodeBalanced(curr, leftHeight, rightHeight)) {
+			return -1;
+		}
+		heights.push_back(1 + std::max(leftHeight, rightHeight));
 
-	return false;
+		if(curr == root_) {
+			return heights.back();
+		}
+		phase = (curr == curr->getParent()->getLeft()) ? 1 : 2;
+		curr = curr->getParent();
+	}
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+/**
+* Per-node test used by isBalanced(): the subtree heights differ by at
+* most one.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+bool BinarySearchTree<Key, Value, Alloc, Stats>::nodeBalanced(Node<Key, Value>* node, int leftHeight, int rightHeight) const
 {
-	return checkIfBalanced(this->root_);
+	return std::abs(leftHeight - rightHeight) <= 1;
 }
-\
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Alloc, typename Stats>
+void BinarySearchTree<Key, Value, Alloc, Stats>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    stats_.swappedNodes();
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
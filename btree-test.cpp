@@ -0,0 +1,172 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <stdint.h>
+#include "btree.h"
+
+using namespace std;
+
+// Checks KeySearch against std::lower_bound / std::upper_bound on every
+// fill from 0 to 33 keys, which covers full vector registers of each lane
+// width plus every length of scalar tail. The keys are the odd entries of
+// the sorted, distinct pool, so searching for each pool entry tries keys
+// that are present, between two keys, below the first and above the last.
+template<typename Key>
+bool keySearchMatches(const vector<Key>& pool)
+{
+    for(int count = 0; count <= 33; ++count) {
+        vector<Key> keys;
+        for(size_t i = 1; i < pool.size() && (int)keys.size() < count; i += 2) {
+            keys.push_back(pool[i]);
+        }
+        int n = (int)keys.size();
+        const Key* data = keys.empty() ? NULL : &keys[0];
+        for(size_t i = 0; i < pool.size(); ++i) {
+            int lower = (int)(std::lower_bound(keys.begin(), keys.end(), pool[i]) - keys.begin());
+            int upper = (int)(std::upper_bound(keys.begin(), keys.end(), pool[i]) - keys.begin());
+            if(KeySearch<Key>::lowerBound(data, n, pool[i]) != lower ||
+               KeySearch<Key>::upperBound(data, n, pool[i]) != upper) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Random inserts and removes on a BTreeMap, checked against std::map
+// element by element, with finds for keys both present and absent
+template<typename Key>
+bool btreeMatches(const vector<Key>& pool)
+{
+    BTreeMap<Key,int> bt;
+    map<Key,int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const Key& key = pool[rand() % pool.size()];
+        if(rand() % 3 != 0) {
+            bt.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            bt.remove(key);
+            expected.erase(key);
+        }
+    }
+
+    bool same = (bt.size() == expected.size());
+    typename BTreeMap<Key,int>::iterator it = bt.begin();
+    for(typename map<Key,int>::iterator ex = expected.begin(); same && ex != expected.end(); ++ex, ++it) {
+        same = (it != bt.end() && it->first == ex->first && it->second == ex->second);
+    }
+    same = same && it == bt.end();
+    for(size_t i = 0; same && i < pool.size(); ++i) {
+        typename BTreeMap<Key,int>::iterator found = bt.find(pool[i]);
+        if(expected.count(pool[i]) == 0) {
+            same = (found == bt.end());
+        }
+        else {
+            same = (found != bt.end() && found->second == expected[pool[i]]);
+        }
+    }
+    return same;
+}
+
+// A sorted pool of distinct keys around zero and both ends of the range,
+// so signed keys cross the sign and unsigned keys cross the top bit that
+// the vector compare flips
+template<typename Key>
+vector<Key> integerPool()
+{
+    vector<Key> pool;
+    Key lowest = numeric_limits<Key>::min();
+    Key highest = numeric_limits<Key>::max();
+    Key middle = (lowest == 0) ? (Key)(highest / 2 + 1) : (Key)0;
+    // 68 keys, so the 33 odd ones reach into every group
+    for(Key i = 0; i < 17; ++i) {
+        pool.push_back((Key)(lowest + i));
+        pool.push_back((Key)(middle - 17 + i));
+        pool.push_back((Key)(middle + i));
+        pool.push_back((Key)(highest - i));
+    }
+    sort(pool.begin(), pool.end());
+    pool.erase(unique(pool.begin(), pool.end()), pool.end());
+    return pool;
+}
+
+template<typename Key>
+vector<Key> floatingPool()
+{
+    vector<Key> pool;
+    pool.push_back(-numeric_limits<Key>::infinity());
+    for(int i = 0; i < 100; ++i) {
+        pool.push_back((Key)(i * 0.75 - 37.5));
+    }
+    pool.push_back(numeric_limits<Key>::infinity());
+    return pool;
+}
+
+
+int main(int argc, char *argv[])
+{
+    // Same calls as the BinarySearchTree tests
+    BTreeMap<char,int> bt;
+    bt.insert(std::make_pair('a',1));
+    bt.insert(std::make_pair('b',2));
+
+    cout << "BTreeMap contents:" << endl;
+    for(BTreeMap<char,int>::iterator it = bt.begin(); it != bt.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(bt.find('b') != bt.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    bt.remove('b');
+
+    // Random inserts and removes, enough to split and merge nodes
+    // several levels deep, checked against std::map
+    BTreeMap<string,int> st;
+    map<string,int> expected;
+    srand(1);
+    for(int i = 0; i < 50000; ++i) {
+        string key = to_string(rand() % 5000);
+        if(rand() % 3 != 0) {
+            st.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            st.remove(key);
+            expected.erase(key);
+        }
+    }
+
+    bool same = (st.size() == expected.size());
+    BTreeMap<string,int>::iterator it = st.begin();
+    for(map<string,int>::iterator ex = expected.begin(); same && ex != expected.end(); ++ex, ++it) {
+        same = (it != st.end() && it->first == ex->first && it->second == ex->second);
+    }
+    cout << "\nBTreeMap matches std::map after 50000 operations: " << (same && it == st.end()) << endl;
+
+    st.clear();
+    cout << "Cleared, empty: " << st.empty() << endl;
+
+    // Numeric keys go through KeySearch's vector lanes (64-bit integers
+    // need SSE4.2 or AVX2, see btree-test-native), the rest through its
+    // scalar tail
+    cout << "KeySearch matches std::lower_bound/upper_bound for int: " << keySearchMatches(integerPool<int>())
+         << ", unsigned: " << keySearchMatches(integerPool<unsigned>())
+         << ", int64_t: " << keySearchMatches(integerPool<int64_t>())
+         << ", uint64_t: " << keySearchMatches(integerPool<uint64_t>())
+         << ", float: " << keySearchMatches(floatingPool<float>())
+         << ", double: " << keySearchMatches(floatingPool<double>()) << endl;
+    cout << "BTreeMap matches std::map for int: " << btreeMatches(integerPool<int>())
+         << ", unsigned: " << btreeMatches(integerPool<unsigned>())
+         << ", uint64_t: " << btreeMatches(integerPool<uint64_t>())
+         << ", double: " << btreeMatches(floatingPool<double>()) << endl;
+}
@@ -0,0 +1,649 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+#include <algorithm>
+#include "node_pool.h"
+#include "key_search.h"
+
+/**
+* A cache-conscious ordered map (a B+ tree) with the same surface as
+* BinarySearchTree: insert/remove/find/begin/end/operator[]/clear/empty.
+*
+* Every node holds a sorted array of keys sized to span a few cache
+* lines, so a lookup costs one miss per level of a tree that is
+* log_B(n) deep instead of log_2(n). Values live only in the leaves,
+* which are linked in key order for iteration. For integer and floating
+* point keys, a node's keys are compared a vector register at a time
+* (see key_search.h).
+*
+* Keys and values are stored in plain arrays, so both must be default
+* constructible and move assignable. Since keys and values are kept in
+* separate arrays, dereferencing an iterator yields a small proxy with
+* 'first' and 'second' references rather than a std::pair&; the usual
+* it->first / it->second call sites work unchanged.
+*/
+template <typename Key, typename Value>
+class BTreeMap
+{
+public:
+    static const int CACHE_LINE = 64;
+    // Keys per node: two cache lines worth, but never fewer than 8
+    static const int LEAF_SLOTS = (2 * CACHE_LINE / (int)sizeof(Key) < 8) ? 8 : 2 * CACHE_LINE / (int)sizeof(Key);
+    static const int INNER_SLOTS = LEAF_SLOTS;
+
+    /**
+    * What an iterator dereferences to.
+    */
+    struct reference
+    {
+        const Key& first;
+        Value& second;
+
+        reference(const Key& key, Value& value) : first(key), second(value) {}
+        reference* operator->() { return this; }
+    };
+
+    class iterator;
+
+    BTreeMap();
+    ~BTreeMap();
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static const int LEAF_MIN = LEAF_SLOTS / 2;
+    static const int INNER_MIN = INNER_SLOTS / 2;
+    static const int MAX_DEPTH = 64;
+
+    struct NodeBase
+    {
+        explicit NodeBase(bool leaf) : leaf_(leaf), count_(0) {}
+        bool leaf_;
+        int count_;     // number of keys
+    };
+
+    // One spare slot lets a node overflow by one before it is split.
+    struct Leaf : public NodeBase
+    {
+        Leaf() : NodeBase(true), prev_(nullptr), next_(nullptr) {}
+        Key keys_[LEAF_SLOTS + 1];
+        Value values_[LEAF_SLOTS + 1];
+        Leaf* prev_;
+        Leaf* next_;
+    };
+
+    // children_[i] holds the keys k with keys_[i-1] <= k < keys_[i].
+    struct Inner : public NodeBase
+    {
+        Inner() : NodeBase(false) {}
+        Key keys_[INNER_SLOTS + 1];
+        NodeBase* children_[INNER_SLOTS + 2];
+    };
+
+    static int leafLowerBound(const Leaf* leaf, const Key& key);
+    static int innerChildIndex(const Inner* inner, const Key& key);
+    Leaf* findLeaf(const Key& key) const;
+    void removeFromInner(Inner* inner, int keyIndex);
+    void rebalanceLeaf(Leaf* leaf, Inner* parent, int slot);
+    bool rebalanceInner(Inner* inner, Inner* parent, int slot);
+    void freeSubtree(NodeBase* node);
+
+    NodeBase* root_;
+    Leaf* head_;        // leftmost leaf
+    std::size_t size_;
+    NodePool<Leaf> leafPool_;
+    NodePool<Inner> innerPool_;
+
+public:
+    /**
+    * Forward iterator over the leaves in key order.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        reference operator*() const;
+        reference operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BTreeMap<Key, Value>;
+        iterator(Leaf* leaf, int index);
+        Leaf* leaf_;
+        int index_;
+    };
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the BTreeMap::iterator class.
+  -----------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+BTreeMap<Key, Value>::iterator::iterator() :
+    leaf_(nullptr),
+    index_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+BTreeMap<Key, Value>::iterator::iterator(Leaf* leaf, int index) :
+    leaf_(leaf),
+    index_(index)
+{
+
+}
+
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::reference
+BTreeMap<Key, Value>::iterator::operator*() const
+{
+    return reference(leaf_->keys_[index_], leaf_->values_[index_]);
+}
+
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::reference
+BTreeMap<Key, Value>::iterator::operator->() const
+{
+    return reference(leaf_->keys_[index_], leaf_->values_[index_]);
+}
+
+template<typename Key, typename Value>
+bool BTreeMap<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value>
+bool BTreeMap<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Steps to the next slot, hopping to the next leaf at the end of one.
+*/
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::iterator&
+BTreeMap<Key, Value>::iterator::operator++()
+{
+    if(++index_ >= leaf_->count_) {
+        leaf_ = leaf_->next_;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the BTreeMap::iterator class.
+  ---------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the BTreeMap class.
+  ---------------------------------------------
+*/
+
+template<typename Key, typename Value>
+BTreeMap<Key, Value>::BTreeMap() :
+    root_(nullptr),
+    head_(nullptr),
+    size_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+BTreeMap<Key, Value>::~BTreeMap()
+{
+    clear();
+}
+
+template<typename Key, typename Value>
+bool BTreeMap<Key, Value>::empty() const
+{
+    return root_ == nullptr;
+}
+
+template<typename Key, typename Value>
+std::size_t BTreeMap<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::iterator
+BTreeMap<Key, Value>::begin() const
+{
+    return iterator(head_, 0);
+}
+
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::iterator
+BTreeMap<Key, Value>::end() const
+{
+    return iterator(nullptr, 0);
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::iterator
+BTreeMap<Key, Value>::find(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if(leaf == nullptr) {
+        return end();
+    }
+    int pos = leafLowerBound(leaf, key);
+    if(pos < leaf->count_ && !(key < leaf->keys_[pos])) {
+        return iterator(leaf, pos);
+    }
+    return end();
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value>
+Value& BTreeMap<Key, Value>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template<typename Key, typename Value>
+Value const & BTreeMap<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present
+* (as BinarySearchTree::insert does). A leaf that overflows is split in
+* half and the split propagates up the recorded descent path.
+*/
+template<typename Key, typename Value>
+std::pair<typename BTreeMap<Key, Value>::iterator, bool>
+BTreeMap<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    const Key& key = keyValuePair.first;
+
+    if(root_ == nullptr) {
+        Leaf* leaf = leafPool_.create();
+        leaf->keys_[0] = key;
+        leaf->values_[0] = keyValuePair.second;
+        leaf->count_ = 1;
+        root_ = head_ = leaf;
+        size_ = 1;
+        return std::make_pair(iterator(leaf, 0), true);
+    }
+
+    Inner* path[MAX_DEPTH];
+    int slots[MAX_DEPTH];
+    int depth = 0;
+
+    NodeBase* node = root_;
+    while(!node->leaf_) {
+        Inner* inner = static_cast<Inner*>(node);
+        int slot = innerChildIndex(inner, key);
+        path[depth] = inner;
+        slots[depth] = slot;
+        ++depth;
+        node = inner->children_[slot];
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int pos = leafLowerBound(leaf, key);
+    if(pos < leaf->count_ && !(key < leaf->keys_[pos])) {
+        leaf->values_[pos] = keyValuePair.second;
+        return std::make_pair(iterator(leaf, pos), false);
+    }
+
+    std::move_backward(leaf->keys_ + pos, leaf->keys_ + leaf->count_, leaf->keys_ + leaf->count_ + 1);
+    std::move_backward(leaf->values_ + pos, leaf->values_ + leaf->count_, leaf->values_ + leaf->count_ + 1);
+    leaf->keys_[pos] = key;
+    leaf->values_[pos] = keyValuePair.second;
+    ++leaf->count_;
+    ++size_;
+
+    if(leaf->count_ <= LEAF_SLOTS) {
+        return std::make_pair(iterator(leaf, pos), true);
+    }
+
+    // Split the leaf: the upper half moves to a new right sibling
+    Leaf* right = leafPool_.create();
+    int leftCount = leaf->count_ / 2;
+    right->count_ = leaf->count_ - leftCount;
+    std::move(leaf->keys_ + leftCount, leaf->keys_ + leaf->count_, right->keys_);
+    std::move(leaf->values_ + leftCount, leaf->values_ + leaf->count_, right->values_);
+    leaf->count_ = leftCount;
+
+    right->next_ = leaf->next_;
+    if(right->next_ != nullptr) {
+        right->next_->prev_ = right;
+    }
+    right->prev_ = leaf;
+    leaf->next_ = right;
+
+    iterator result = (pos < leftCount) ? iterator(leaf, pos) : iterator(right, pos - leftCount);
+
+    // Push the separator up, splitting full inner nodes on the way
+    Key separator = right->keys_[0];
+    NodeBase* newChild = right;
+    while(true) {
+        if(depth == 0) {
+            Inner* newRoot = innerPool_.create();
+            newRoot->keys_[0] = std::move(separator);
+            newRoot->children_[0] = root_;
+            newRoot->children_[1] = newChild;
+            newRoot->count_ = 1;
+            root_ = newRoot;
+            break;
+        }
+
+        --depth;
+        Inner* parent = path[depth];
+        int slot = slots[depth];
+        std::move_backward(parent->keys_ + slot, parent->keys_ + parent->count_, parent->keys_ + parent->count_ + 1);
+        std::move_backward(parent->children_ + slot + 1, parent->children_ + parent->count_ + 1,
+                           parent->children_ + parent->count_ + 2);
+        parent->keys_[slot] = std::move(separator);
+        parent->children_[slot + 1] = newChild;
+        ++parent->count_;
+
+        if(parent->count_ <= INNER_SLOTS) {
+            break;
+        }
+
+        // The middle key moves up; the keys and children right of it go to a new node
+        Inner* rightInner = innerPool_.create();
+        int mid = parent->count_ / 2;
+        rightInner->count_ = parent->count_ - mid - 1;
+        std::move(parent->keys_ + mid + 1, parent->keys_ + parent->count_, rightInner->keys_);
+        std::copy(parent->children_ + mid + 1, parent->children_ + parent->count_ + 1, rightInner->children_);
+        separator = std::move(parent->keys_[mid]);
+        parent->count_ = mid;
+        newChild = rightInner;
+    }
+
+    return std::make_pair(result, true);
+}
+
+/**
+* Removes the key if present. A leaf left less than half full borrows
+* from a sibling or is merged into one, and merges propagate up the
+* recorded descent path.
+*/
+template<typename Key, typename Value>
+void BTreeMap<Key, Value>::remove(const Key& key)
+{
+    if(root_ == nullptr) {
+        return;
+    }
+
+    Inner* path[MAX_DEPTH];
+    int slots[MAX_DEPTH];
+    int depth = 0;
+
+    NodeBase* node = root_;
+    while(!node->leaf_) {
+        Inner* inner = static_cast<Inner*>(node);
+        int slot = innerChildIndex(inner, key);
+        path[depth] = inner;
+        slots[depth] = slot;
+        ++depth;
+        node = inner->children_[slot];
+    }
+
+    Leaf* leaf = static_cast<Leaf*>(node);
+    int pos = leafLowerBound(leaf, key);
+    if(pos >= leaf->count_ || key < leaf->keys_[pos]) {
+        return;
+    }
+
+    std::move(leaf->keys_ + pos + 1, leaf->keys_ + leaf->count_, leaf->keys_ + pos);
+    std::move(leaf->values_ + pos + 1, leaf->values_ + leaf->count_, leaf->values_ + pos);
+    --leaf->count_;
+    --size_;
+
+    if(depth == 0) { //The leaf is the root
+        if(leaf->count_ == 0) {
+            leafPool_.destroy(leaf);
+            root_ = head_ = nullptr;
+        }
+        return;
+    }
+
+    if(leaf->count_ >= LEAF_MIN) {
+        return;
+    }
+
+    --depth;
+    rebalanceLeaf(leaf, path[depth], slots[depth]);
+
+    // Walk up while merges leave inner nodes underfull
+    Inner* inner = path[depth];
+    while(depth > 0 && inner->count_ < INNER_MIN) {
+        --depth;
+        if(!rebalanceInner(inner, path[depth], slots[depth])) {
+            break;
+        }
+        inner = path[depth];
+    }
+
+    // A root with a single child is replaced by that child
+    if(!root_->leaf_ && root_->count_ == 0) {
+        Inner* oldRoot = static_cast<Inner*>(root_);
+        root_ = oldRoot->children_[0];
+        innerPool_.destroy(oldRoot);
+    }
+}
+
+/**
+* Frees every node and resets the map for use again.
+*/
+template<typename Key, typename Value>
+void BTreeMap<Key, Value>::clear()
+{
+    if(root_ != nullptr) {
+        freeSubtree(root_);
+    }
+    root_ = nullptr;
+    head_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Index of the first key in the leaf that is not less than key. See
+* key_search.h for how the search is done.
+*/
+template<typename Key, typename Value>
+int BTreeMap<Key, Value>::leafLowerBound(const Leaf* leaf, const Key& key)
+{
+    return KeySearch<Key>::lowerBound(leaf->keys_, leaf->count_, key);
+}
+
+/**
+* Index of the child whose range contains key: the number of separators
+* that are less than or equal to key.
+*/
+template<typename Key, typename Value>
+int BTreeMap<Key, Value>::innerChildIndex(const Inner* inner, const Key& key)
+{
+    return KeySearch<Key>::upperBound(inner->keys_, inner->count_, key);
+}
+
+/**
+* Descends to the leaf whose range contains key, or NULL for an empty map.
+*/
+template<typename Key, typename Value>
+typename BTreeMap<Key, Value>::Leaf*
+BTreeMap<Key, Value>::findLeaf(const Key& key) const
+{
+    NodeBase* node = root_;
+    if(node == nullptr) {
+        return nullptr;
+    }
+    while(!node->leaf_) {
+        const Inner* inner = static_cast<const Inner*>(node);
+        node = inner->children_[innerChildIndex(inner, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* Removes keys_[keyIndex] and the child to its right from an inner node.
+*/
+template<typename Key, typename Value>
+void BTreeMap<Key, Value>::removeFromInner(Inner* inner, int keyIndex)
+{
+    std::move(inner->keys_ + keyIndex + 1, inner->keys_ + inner->count_, inner->keys_ + keyIndex);
+    std::copy(inner->children_ + keyIndex + 2, inner->children_ + inner->count_ + 1, inner->children_ + keyIndex + 1);
+    --inner->count_;
+}
+
+/**
+* Refills an underfull leaf (parent->children_[slot]) from a sibling that
+* can spare a key, or merges it with a sibling otherwise.
+*/
+template<typename Key, typename Value>
+void BTreeMap<Key, Value>::rebalanceLeaf(Leaf* leaf, Inner* parent, int slot)
+{
+    Leaf* left = (slot > 0) ? static_cast<Leaf*>(parent->children_[slot - 1]) : nullptr;
+    Leaf* right = (slot < parent->count_) ? static_cast<Leaf*>(parent->children_[slot + 1]) : nullptr;
+
+    if(left != nullptr && left->count_ > LEAF_MIN) { //Borrow the largest key of the left sibling
+        std::move_backward(leaf->keys_, leaf->keys_ + leaf->count_, leaf->keys_ + leaf->count_ + 1);
+        std::move_backward(leaf->values_, leaf->values_ + leaf->count_, leaf->values_ + leaf->count_ + 1);
+        leaf->keys_[0] = std::move(left->keys_[left->count_ - 1]);
+        leaf->values_[0] = std::move(left->values_[left->count_ - 1]);
+        --left->count_;
+        ++leaf->count_;
+        parent->keys_[slot - 1] = leaf->keys_[0];
+        return;
+    }
+
+    if(right != nullptr && right->count_ > LEAF_MIN) { //Borrow the smallest key of the right sibling
+        leaf->keys_[leaf->count_] = std::move(right->keys_[0]);
+        leaf->values_[leaf->count_] = std::move(right->values_[0]);
+        ++leaf->count_;
+        std::move(right->keys_ + 1, right->keys_ + right->count_, right->keys_);
+        std::move(right->values_ + 1, right->values_ + right->count_, right->values_);
+        --right->count_;
+        parent->keys_[slot] = right->keys_[0];
+        return;
+    }
+
+    // Merge with a sibling: fold the right node of the pair into the left one
+    Leaf* into = (left != nullptr) ? left : leaf;
+    Leaf* from = (left != nullptr) ? leaf : right;
+    int separator = (left != nullptr) ? slot - 1 : slot;
+
+    std::move(from->keys_, from->keys_ + from->count_, into->keys_ + into->count_);
+    std::move(from->values_, from->values_ + from->count_, into->values_ + into->count_);
+    into->count_ += from->count_;
+
+    into->next_ = from->next_;
+    if(into->next_ != nullptr) {
+        into->next_->prev_ = into;
+    }
+    leafPool_.destroy(from);
+    removeFromInner(parent, separator);
+}
+
+/**
+* Inner-node version of rebalanceLeaf: the separator in the parent
+* rotates down and a sibling key rotates up. Returns true if a merge
+* took a key away from the parent, which may now be underfull itself.
+*/
+template<typename Key, typename Value>
+bool BTreeMap<Key, Value>::rebalanceInner(Inner* inner, Inner* parent, int slot)
+{
+    Inner* left = (slot > 0) ? static_cast<Inner*>(parent->children_[slot - 1]) : nullptr;
+    Inner* right = (slot < parent->count_) ? static_cast<Inner*>(parent->children_[slot + 1]) : nullptr;
+
+    if(left != nullptr && left->count_ > INNER_MIN) {
+        std::move_backward(inner->keys_, inner->keys_ + inner->count_, inner->keys_ + inner->count_ + 1);
+        std::copy_backward(inner->children_, inner->children_ + inner->count_ + 1, inner->children_ + inner->count_ + 2);
+        inner->keys_[0] = std::move(parent->keys_[slot - 1]);
+        inner->children_[0] = left->children_[left->count_];
+        parent->keys_[slot - 1] = std::move(left->keys_[left->count_ - 1]);
+        --left->count_;
+        ++inner->count_;
+        return false;
+    }
+
+    if(right != nullptr && right->count_ > INNER_MIN) {
+        inner->keys_[inner->count_] = std::move(parent->keys_[slot]);
+        inner->children_[inner->count_ + 1] = right->children_[0];
+        ++inner->count_;
+        parent->keys_[slot] = std::move(right->keys_[0]);
+        std::move(right->keys_ + 1, right->keys_ + right->count_, right->keys_);
+        std::copy(right->children_ + 1, right->children_ + right->count_ + 1, right->children_);
+        --right->count_;
+        return false;
+    }
+
+    Inner* into = (left != nullptr) ? left : inner;
+    Inner* from = (left != nullptr) ? inner : right;
+    int separator = (left != nullptr) ? slot - 1 : slot;
+
+    into->keys_[into->count_] = std::move(parent->keys_[separator]);
+    std::move(from->keys_, from->keys_ + from->count_, into->keys_ + into->count_ + 1);
+    std::copy(from->children_, from->children_ + from->count_ + 1, into->children_ + into->count_ + 1);
+    into->count_ += 1 + from->count_;
+
+    innerPool_.destroy(from);
+    removeFromInner(parent, separator);
+    return true;
+}
+
+template<typename Key, typename Value>
+void BTreeMap<Key, Value>::freeSubtree(NodeBase* node)
+{
+    if(node->leaf_) {
+        leafPool_.destroy(static_cast<Leaf*>(node));
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for(int i = 0; i <= inner->count_; ++i) {
+        freeSubtree(inner->children_[i]);
+    }
+    innerPool_.destroy(inner);
+}
+
+/*
+  -------------------------------------------
+  End implementations for the BTreeMap class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <stdexcept>
+#include "concurrent_avl.h"
+
+using namespace std;
+
+// A value whose copy throws when a countdown reaches zero
+struct FragileValue
+{
+    FragileValue(int v) : value(v) {}
+    FragileValue(const FragileValue& other) : value(other.value)
+    {
+        if(countdown > 0 && --countdown == 0) {
+            throw runtime_error("copy refused");
+        }
+    }
+    FragileValue& operator=(const FragileValue& other) = default;
+
+    int value;
+    static int countdown;
+};
+int FragileValue::countdown = 0;
+
+
+int main(int argc, char *argv[])
+{
+    ConcurrentAVLTree<int,int> ct;
+    ct.insert(std::make_pair(1,10));
+    ct.insert(std::make_pair(2,20));
+
+    int value = 0;
+    if(ct.find(2, value)) {
+        cout << "Found 2 -> " << value << endl;
+    }
+    cout << "ct[1] = " << ct[1] << endl;
+    ct.remove(2);
+    cout << "Contains 2 after remove: " << ct.contains(2) << endl;
+    ct.clear();
+
+    // Writes that fail on the second copy are undone on the first. A
+    // remove of a missing key flips readers from one copy to the other.
+    ConcurrentAVLTree<int,FragileValue> ft;
+    ft.insert(std::make_pair(1, FragileValue(10)));
+    std::pair<const int, FragileValue> added(2, FragileValue(20));
+    std::pair<const int, FragileValue> changed(1, FragileValue(11));
+    FragileValue::countdown = 2;    // the new key's copy into the second tree
+    try {
+        ft.insert(added);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    FragileValue::countdown = 3;    // the new value's copy for the second tree
+    try {
+        ft.insert(changed);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    bool unchanged = true;
+    for(int i = 0; i < 2; ++i) {
+        FragileValue found(0);
+        unchanged = unchanged && !ft.contains(2) && ft.find(1, found) && found.value == 10;
+        ft.remove(99);
+    }
+    cout << "Both copies unchanged by failed inserts: " << unchanged << endl;
+
+    // Readers look up the even keys, which are always present and always
+    // hold key + 1000 * round, while one writer bumps the round and adds
+    // and removes odd keys around them until the readers are done.
+    const int KEYS = 2000;
+    const int LOOKUPS = 100000;
+    for(int k = 0; k < KEYS; k += 2) {
+        ct.insert(std::make_pair(k, k));
+    }
+
+    atomic<int> running(4);
+    atomic<long> bad(0);
+    vector<thread> readers;
+    for(int r = 0; r < 4; ++r) {
+        readers.push_back(thread([&ct, &running, &bad, r]() {
+            int k = r * 2;
+            for(int i = 0; i < LOOKUPS; ++i) {
+                int found = -1;
+                if(!ct.find(k, found) || found < k || (found - k) % 1000 != 0) {
+                    ++bad;
+                }
+                k = (k + 2) % KEYS;
+            }
+            --running;
+        }));
+    }
+
+    int round = 0;
+    while(running.load() > 0) {
+        ++round;
+        for(int k = 0; k < KEYS; ++k) {
+            if(k % 2 == 0) {
+                ct.insert(std::make_pair(k, k + 1000 * round));
+            }
+            else if(round % 2 == 1) {
+                ct.insert(std::make_pair(k, k));
+            }
+            else {
+                ct.remove(k);
+            }
+        }
+    }
+    for(size_t i = 0; i < readers.size(); ++i) {
+        readers[i].join();
+    }
+
+    cout << "\nReaders saw a consistent tree: " << (bad.load() == 0) << endl;
+    cout << "Final values correct: "
+         << (ct[10] == 10 + 1000 * round && ct.contains(11) == (round % 2 == 1)) << endl;
+    cout << "Balanced: " << ct.read([](const ConcurrentAVLTree<int,int>::Tree& tree) {
+        return tree.isBalanced();
+    }) << endl;
+
+    // A parallel merge into a tree that counts: the counters are plain
+    // integers, so it must rebalance on one thread and count exactly what
+    // a one-thread merge does. Build with 'make tsan' to check for races.
+    typedef AVLTree<int,int,NodePool<AVLNode<int,int> >,TreeStats> CountedTree;
+    CountedTree big, small, bigCopy, smallCopy;
+    srand(7);
+    for(int i = 0; i < 200000; ++i) {
+        int k = rand();
+        big.insert(std::make_pair(k, i));
+        bigCopy.insert(std::make_pair(k, i));
+    }
+    for(int i = 0; i < 30000; ++i) {
+        int k = rand();
+        small.insert(std::make_pair(k, i));
+        smallCopy.insert(std::make_pair(k, i));
+    }
+    big.stats().reset();
+    bigCopy.stats().reset();
+    big.merge(small, 8);
+    bigCopy.merge(smallCopy, 1);
+    cout << "\nCounted merge: " << big.size() << " items, balanced: " << big.isBalanced()
+         << ", same rotations as one thread: "
+         << (big.stats().leftRotations == bigCopy.stats().leftRotations &&
+             big.stats().rightRotations == bigCopy.stats().rightRotations) << endl;
+}
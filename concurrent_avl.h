@@ -0,0 +1,325 @@
+#ifndef CONCURRENT_AVL_H
+#define CONCURRENT_AVL_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* An AVLTree that many threads can read while one thread at a time writes.
+*
+* It uses the Left-Right technique: two copies of the tree are kept, and
+* readers always use the copy that is not being written. A writer applies
+* its change to the idle copy, flips readers over to it, waits for readers
+* still in the old copy to leave, then replays the change there. Readers
+* never take a lock and never wait on a writer: a lookup is one atomic
+* increment and decrement around an ordinary AVLTree::find, whatever the
+* writers are doing. Writers are serialized by a mutex and pay for two
+* tree updates plus the wait for in-flight readers.
+*
+* Reads return copies of values, since a reference into either copy could
+* be overwritten by the next writer. read() runs a caller supplied function
+* against a consistent tree, for anything more than a single lookup (e.g.
+* iteration); the function must not modify the tree or keep references
+* into it after returning.
+*
+* A write that throws leaves both copies as they were. That needs key
+* comparisons and Value's destructor and move assignment not to throw;
+* insert copies its value before changing anything, so a throwing Value
+* copy or a failed allocation is fine.
+*
+* The price is twice the memory of a single tree.
+*/
+template <typename Key, typename Value, typename Alloc = NodePool<AVLNode<Key, Value> > >
+class ConcurrentAVLTree
+{
+public:
+    typedef AVLTree<Key, Value, Alloc> Tree;
+
+    ConcurrentAVLTree();
+
+    // Reads: never block
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    Value operator[](const Key& key) const;
+    bool empty() const;
+    template<typename Func>
+    auto read(Func func) const -> decltype(func(std::declval<const Tree&>()));
+
+    // Writes: serialized among themselves
+    bool insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+protected:
+    // Spread reader arrivals over several cache lines so that readers on
+    // different cores do not all contend on one counter.
+    static const std::size_t READ_STRIPES = 16;
+
+    struct alignas(64) ReadCounter
+    {
+        ReadCounter() : count(0) {}
+        std::atomic<long> count;
+    };
+
+    static std::size_t readerStripe();
+    void arrive(int version) const;
+    void depart(int version) const;
+    bool readersGone(int version) const;
+    void toggleVersionAndWait();
+
+    template<typename Func>
+    void write(Func func);
+    template<typename Func, typename Undo>
+    void write(Func func, Undo undo);
+
+    Tree trees_[2];
+    std::atomic<int> leftRight_;        // which tree readers use
+    std::atomic<int> versionIndex_;     // which read counters new readers use
+    mutable ReadCounter readers_[2][READ_STRIPES];
+    std::mutex writeMutex_;
+
+private:
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+};
+
+/*
+  -------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  -------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Alloc>
+ConcurrentAVLTree<Key, Value, Alloc>::ConcurrentAVLTree() :
+    leftRight_(0),
+    versionIndex_(0)
+{
+
+}
+
+/**
+* Each thread is handed a stripe the first time it reads.
+*/
+template<typename Key, typename Value, typename Alloc>
+std::size_t ConcurrentAVLTree<Key, Value, Alloc>::readerStripe()
+{
+    static std::atomic<std::size_t> nextStripe(0);
+    static thread_local std::size_t stripe = nextStripe++ % READ_STRIPES;
+    return stripe;
+}
+
+template<typename Key, typename Value, typename Alloc>
+void ConcurrentAVLTree<Key, Value, Alloc>::arrive(int version) const
+{
+    readers_[version][readerStripe()].count.fetch_add(1);
+}
+
+template<typename Key, typename Value, typename Alloc>
+void ConcurrentAVLTree<Key, Value, Alloc>::depart(int version) const
+{
+    readers_[version][readerStripe()].count.fetch_sub(1);
+}
+
+template<typename Key, typename Value, typename Alloc>
+bool ConcurrentAVLTree<Key, Value, Alloc>::readersGone(int version) const
+{
+    for(std::size_t i = 0; i < READ_STRIPES; ++i) {
+        if(readers_[version][i].count.load() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+* Moves new readers onto the other set of counters, then waits until every
+* reader that arrived on the old set has left. Afterwards no reader can
+* still be looking at the tree readers were using before the last flip.
+*/
+template<typename Key, typename Value, typename Alloc>
+void ConcurrentAVLTree<Key, Value, Alloc>::toggleVersionAndWait()
+{
+    int prev = versionIndex_.load();
+    int next = 1 - prev;
+
+    // Readers of two flips ago may still be draining from 'next'
+    while(!readersGone(next)) {
+        std::this_thread::yield();
+    }
+    versionIndex_.store(next);
+    while(!readersGone(prev)) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+* Applies func to both trees, one at a time, so that readers always have
+* a tree that is not being modified. func must not throw.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename Func>
+void ConcurrentAVLTree<Key, Value, Alloc>::write(Func func)
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    int current = leftRight_.load();
+    func(trees_[1 - current]);
+    leftRight_.store(1 - current);
+    toggleVersionAndWait();
+    func(trees_[current]);
+}
+
+/**
+* As above, for a func that may throw but leaves its tree as it was when
+* it does. If it throws on the first tree nothing has been published. If
+* it throws on the second, readers are moved back onto that tree and
+* undo, which must not throw, reverses the change on the first.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename Func, typename Undo>
+void ConcurrentAVLTree<Key, Value, Alloc>::write(Func func, Undo undo)
+{
+    std::lock_guard<std::mutex> lock(writeMutex_);
+    int current = leftRight_.load();
+    func(trees_[1 - current]);
+    leftRight_.store(1 - current);
+    toggleVersionAndWait();
+    try {
+        func(trees_[current]);
+    }
+    catch(...) {
+        leftRight_.store(current);
+        toggleVersionAndWait();
+        undo(trees_[1 - current]);
+        throw;
+    }
+}
+
+/**
+* Runs func(const Tree&) against the tree readers currently use and
+* returns its result.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename Func>
+auto ConcurrentAVLTree<Key, Value, Alloc>::read(Func func) const -> decltype(func(std::declval<const Tree&>()))
+{
+    // Leaves the read counter even if func throws
+    struct Departure
+    {
+        const ConcurrentAVLTree* owner;
+        int version;
+        ~Departure() { owner->depart(version); }
+    };
+
+    int version = versionIndex_.load();
+    arrive(version);
+    Departure departure = { this, version };
+    return func(static_cast<const Tree&>(trees_[leftRight_.load()]));
+}
+
+/**
+* Copies the value for key into value. Returns false, leaving value
+* untouched, if the key is not present.
+*/
+template<typename Key, typename Value, typename Alloc>
+bool ConcurrentAVLTree<Key, Value, Alloc>::find(const Key& key, Value& value) const
+{
+    return read([&key, &value](const Tree& tree) -> bool {
+        typename Tree::iterator it = tree.find(key);
+        if(it == tree.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    });
+}
+
+template<typename Key, typename Value, typename Alloc>
+bool ConcurrentAVLTree<Key, Value, Alloc>::contains(const Key& key) const
+{
+    return read([&key](const Tree& tree) {
+        return tree.find(key) != tree.end();
+    });
+}
+
+/**
+* @precondition The key exists in the map
+* Returns a copy of the value associated with the key
+*/
+template<typename Key, typename Value, typename Alloc>
+Value ConcurrentAVLTree<Key, Value, Alloc>::operator[](const Key& key) const
+{
+    Value value;
+    if(!find(key, value)) throw std::out_of_range("Invalid key");
+    return value;
+}
+
+template<typename Key, typename Value, typename Alloc>
+bool ConcurrentAVLTree<Key, Value, Alloc>::empty() const
+{
+    return read([](const Tree& tree) {
+        return tree.empty();
+    });
+}
+
+/**
+* Inserts or overwrites the item. Returns true if the key was new. Each
+* tree either gets the whole change or is left as it was: a new value is
+* copied before it replaces the old one, and the old value is kept in
+* case the change has to be undone.
+*/
+template<typename Key, typename Value, typename Alloc>
+bool ConcurrentAVLTree<Key, Value, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool inserted = false;
+    std::unique_ptr<Value> previous;
+    write([&keyValuePair, &inserted, &previous](Tree& tree) {
+        std::pair<typename Tree::iterator, bool> result =
+            tree.try_emplace(keyValuePair.first, keyValuePair.second);
+        inserted = result.second;
+        if(!inserted) {
+            Value copy(keyValuePair.second);
+            if(!previous) {
+                previous.reset(new Value(result.first->second));
+            }
+            result.first->second = std::move(copy);
+        }
+    }, [&keyValuePair, &inserted, &previous](Tree& tree) {
+        if(inserted) {
+            tree.remove(keyValuePair.first);
+        }
+        else {
+            tree.find(keyValuePair.first)->second = std::move(*previous);
+        }
+    });
+    return inserted;
+}
+
+template<typename Key, typename Value, typename Alloc>
+void ConcurrentAVLTree<Key, Value, Alloc>::remove(const Key& key)
+{
+    write([&key](Tree& tree) {
+        tree.remove(key);
+    });
+}
+
+template<typename Key, typename Value, typename Alloc>
+void ConcurrentAVLTree<Key, Value, Alloc>::clear()
+{
+    write([](Tree& tree) {
+        tree.clear();
+    });
+}
+
+/*
+  -----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  -----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+#include "avlbst.h"
+#include "frozen_map.h"
+
+using namespace std;
+
+
+int main(int argc, char *argv[])
+{
+    AVLTree<char,int> at;
+    at.insert(std::make_pair('a',1));
+    at.insert(std::make_pair('b',2));
+    FrozenMap<char,int> fm = freeze(at);
+    at.remove('b');
+
+    cout << "FrozenMap contents:" << endl;
+    for(FrozenMap<char,int>::iterator it = fm.begin(); it != fm.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+    if(fm.find('b') != fm.end()) {
+        cout << "Found b after removing it from the tree" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+
+    // Every kind of lookup on every size up to a few levels, checked
+    // against std::map
+    bool same = true;
+    srand(1);
+    for(int n = 0; n < 300 && same; ++n) {
+        AVLTree<string,int> tree;
+        map<string,int> expected;
+        for(int i = 0; i < n; ++i) {
+            string key = to_string(rand() % 1000);
+            tree.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        FrozenMap<string,int> frozen = freeze(tree);
+        same = (frozen.size() == expected.size());
+        for(int q = 0; q < 1000 && same; ++q) {
+            string key = to_string(q);
+            FrozenMap<string,int>::iterator found = frozen.find(key);
+            FrozenMap<string,int>::iterator lo = frozen.lower_bound(key);
+            FrozenMap<string,int>::iterator hi = frozen.upper_bound(key);
+            map<string,int>::iterator exFound = expected.find(key);
+            map<string,int>::iterator exLo = expected.lower_bound(key);
+            map<string,int>::iterator exHi = expected.upper_bound(key);
+            same = ((found == frozen.end()) == (exFound == expected.end())) &&
+                   (found == frozen.end() || found->second == exFound->second) &&
+                   ((lo == frozen.end()) == (exLo == expected.end())) &&
+                   (lo == frozen.end() || lo->first == exLo->first) &&
+                   ((hi == frozen.end()) == (exHi == expected.end())) &&
+                   (hi == frozen.end() || hi->first == exHi->first);
+        }
+    }
+    cout << "\nFrozenMap matches std::map for sizes 0 to 299: " << same << endl;
+
+    FrozenMap<int,int> big;
+    {
+        AVLTree<int,int> tree;
+        for(int i = 0; i < 1000; ++i) {
+            tree.insert(std::make_pair(i * 2, i));
+        }
+        big = freeze(tree);
+    }
+    cout << "Frozen " << big.size() << ", lower_bound(501): " << big.lower_bound(501)->first
+         << ", big[1998]: " << big[1998] << ", largest: " << big.rbegin()->first << endl;
+
+    pair<int,int> unsorted[] = { make_pair(2, 0), make_pair(1, 0) };
+    try {
+        FrozenMap<int,int> bad(unsorted, unsorted + 2);
+    }
+    catch(const invalid_argument& e) {
+        cout << "Unsorted input rejected: " << e.what() << endl;
+    }
+}
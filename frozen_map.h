@@ -0,0 +1,351 @@
+#ifndef FROZEN_MAP_H
+#define FROZEN_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* A read-only ordered map for data that is written once and then only
+* searched: find, lower_bound, upper_bound, equal_range and iteration,
+* no insert or remove. Build one from sorted items, or from any tree with
+* freeze(tree).
+*
+* The keys are laid out in Eytzinger (breadth-first) order: the root at
+* index 1 and the children of k at 2k and 2k+1. A search is then a loop
+* of k = 2k + (keys[k] < key) with no branch to mispredict, and the four
+* levels below k for int keys (sixteen consecutive keys starting at 16k)
+* sit in one cache line, which is prefetched while the upper levels are
+* still being compared. The key array is aligned so those blocks do not
+* straddle lines.
+*
+* Items are also kept in a sorted array, which is what iterators walk and
+* what find returns into, with each Eytzinger slot recording its item's
+* position. So memory is each key twice plus each value plus four bytes,
+* all in three contiguous arrays. At most 2^32 - 1 items.
+*/
+template <typename Key, typename Value>
+class FrozenMap
+{
+public:
+    typedef std::pair<const Key, Value> value_type;
+    typedef typename std::vector<value_type>::const_iterator iterator;
+    typedef iterator const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef reverse_iterator const_reverse_iterator;
+
+    FrozenMap();
+    template<typename ForwardIt>
+    FrozenMap(ForwardIt first, ForwardIt last);
+    FrozenMap(const FrozenMap& other);
+    FrozenMap(FrozenMap&& other) = default;
+    FrozenMap& operator=(FrozenMap other);
+
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    iterator find(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+
+protected:
+    static const std::size_t CACHE_LINE = 64;
+    // Distance in slots to the descendants whose cache line is prefetched:
+    // those four levels down for keys of up to 4 bytes, three for 8, ...
+    static const std::size_t PREFETCH_STRIDE =
+        sizeof(Key) <= 4 ? 16 : sizeof(Key) <= 8 ? 8 : sizeof(Key) <= 16 ? 4 : 2;
+
+    template<typename ForwardIt>
+    void build(ForwardIt first, ForwardIt last);
+    void layout(std::size_t& next, std::size_t slot);
+    template<bool Upper>
+    std::size_t descend(const Key& key) const;
+    static std::size_t trailingOnes(std::size_t k);
+
+    const Key& keyAt(std::size_t slot) const;
+    Key& keyAt(std::size_t slot);
+
+    std::vector<value_type> items_;     // sorted
+    std::vector<Key> keys_;             // Eytzinger order, from keys_[keyBase_ + 1]
+    std::vector<uint32_t> positions_;   // positions_[slot]: index into items_
+    std::size_t keyBase_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FrozenMap class.
+  -----------------------------------------------
+*/
+
+template<typename Key, typename Value>
+FrozenMap<Key, Value>::FrozenMap() :
+    keyBase_(0)
+{
+
+}
+
+/**
+* Builds the map from items in strictly increasing key order, such as a
+* tree's begin() to end(). Throws std::invalid_argument if they are not.
+*/
+template<typename Key, typename Value>
+template<typename ForwardIt>
+FrozenMap<Key, Value>::FrozenMap(ForwardIt first, ForwardIt last) :
+    keyBase_(0)
+{
+    build(first, last);
+}
+
+/**
+* A copy is laid out again, since the alignment of the key array depends
+* on where the vector's storage landed.
+*/
+template<typename Key, typename Value>
+FrozenMap<Key, Value>::FrozenMap(const FrozenMap& other) :
+    keyBase_(0)
+{
+    build(other.begin(), other.end());
+}
+
+template<typename Key, typename Value>
+FrozenMap<Key, Value>& FrozenMap<Key, Value>::operator=(FrozenMap other)
+{
+    items_.swap(other.items_);
+    keys_.swap(other.keys_);
+    positions_.swap(other.positions_);
+    std::swap(keyBase_, other.keyBase_);
+    return *this;
+}
+
+template<typename Key, typename Value>
+template<typename ForwardIt>
+void FrozenMap<Key, Value>::build(ForwardIt first, ForwardIt last)
+{
+    // Works for iterators that yield a proxy rather than a pair (BTreeMap)
+    for(ForwardIt it = first; it != last; ++it) {
+        if(!items_.empty() && !(items_.back().first < it->first)) {
+            throw std::invalid_argument("FrozenMap input must be sorted by strictly increasing key");
+        }
+        items_.emplace_back(it->first, it->second);
+    }
+    if(items_.empty()) {
+        return;
+    }
+    if(items_.size() >= 0xFFFFFFFFu) {
+        throw std::length_error("FrozenMap is limited to 2^32 - 1 items");
+    }
+
+    // Slot 0 is unused. Room for up to a cache line of padding in front
+    // lets slot 0 start on a line boundary, so each prefetched block of
+    // PREFETCH_STRIDE keys starting at a multiple of it is one line.
+    std::size_t padding = CACHE_LINE / sizeof(Key);
+    keys_.assign(padding + items_.size() + 1, items_.front().first);
+    keyBase_ = 0;
+    while(keyBase_ < padding &&
+          reinterpret_cast<std::uintptr_t>(&keys_[keyBase_]) % CACHE_LINE != 0) {
+        ++keyBase_;
+    }
+    if(keyBase_ == padding) {
+        keyBase_ = 0;
+    }
+    positions_.assign(items_.size() + 1, 0);
+
+    std::size_t next = 0;
+    layout(next, 1);
+}
+
+/**
+* An in-order walk of the implicit tree, handing out the sorted items in
+* turn. The recursion is as deep as the tree, about log2(n).
+*/
+template<typename Key, typename Value>
+void FrozenMap<Key, Value>::layout(std::size_t& next, std::size_t slot)
+{
+    if(slot > items_.size()) {
+        return;
+    }
+    layout(next, 2 * slot);
+    keyAt(slot) = items_[next].first;
+    positions_[slot] = static_cast<uint32_t>(next);
+    ++next;
+    layout(next, 2 * slot + 1);
+}
+
+/**
+* Walks from the root to below a leaf, going right past every key less
+* than key (or, for Upper, not greater than key). The bits of the final
+* index record the turns taken; cancelling the trailing right turns and
+* the last left turn gives the slot of the first key that was not passed,
+* or 0 if every key was.
+*/
+template<typename Key, typename Value>
+template<bool Upper>
+std::size_t FrozenMap<Key, Value>::descend(const Key& key) const
+{
+    const Key* keys = keys_.data() + keyBase_;
+    std::size_t n = items_.size();
+    std::size_t k = 1;
+    while(k <= n) {
+        // Near the bottom the descendants are past the array, and even
+        // forming a pointer there is undefined, so clamp to the last key
+        std::size_t ahead = PREFETCH_STRIDE * k;
+        BST_PREFETCH(keys + (ahead <= n ? ahead : n));
+        bool right = Upper ? !(key < keys[k]) : keys[k] < key;
+        k = 2 * k + right;
+    }
+    return k >> (trailingOnes(k) + 1);
+}
+
+template<typename Key, typename Value>
+std::size_t FrozenMap<Key, Value>::trailingOnes(std::size_t k)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(~static_cast<unsigned long long>(k));
+#else
+    std::size_t ones = 0;
+    while(k & 1) {
+        k >>= 1;
+        ++ones;
+    }
+    return ones;
+#endif
+}
+
+template<typename Key, typename Value>
+const Key& FrozenMap<Key, Value>::keyAt(std::size_t slot) const
+{
+    return keys_[keyBase_ + slot];
+}
+
+template<typename Key, typename Value>
+Key& FrozenMap<Key, Value>::keyAt(std::size_t slot)
+{
+    return keys_[keyBase_ + slot];
+}
+
+template<typename Key, typename Value>
+bool FrozenMap<Key, Value>::empty() const
+{
+    return items_.empty();
+}
+
+template<typename Key, typename Value>
+std::size_t FrozenMap<Key, Value>::size() const
+{
+    return items_.size();
+}
+
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::iterator
+FrozenMap<Key, Value>::begin() const
+{
+    return items_.begin();
+}
+
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::iterator
+FrozenMap<Key, Value>::end() const
+{
+    return items_.end();
+}
+
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::reverse_iterator
+FrozenMap<Key, Value>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::reverse_iterator
+FrozenMap<Key, Value>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+/**
+* Returns the first item whose key is not less than key, or end().
+*/
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::iterator
+FrozenMap<Key, Value>::lower_bound(const Key& key) const
+{
+    std::size_t slot = descend<false>(key);
+    return (slot == 0) ? end() : begin() + positions_[slot];
+}
+
+/**
+* Returns the first item whose key is greater than key, or end().
+*/
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::iterator
+FrozenMap<Key, Value>::upper_bound(const Key& key) const
+{
+    std::size_t slot = descend<true>(key);
+    return (slot == 0) ? end() : begin() + positions_[slot];
+}
+
+template<typename Key, typename Value>
+std::pair<typename FrozenMap<Key, Value>::iterator, typename FrozenMap<Key, Value>::iterator>
+FrozenMap<Key, Value>::equal_range(const Key& key) const
+{
+    iterator lo = lower_bound(key);
+    iterator hi = (lo != end() && !(key < lo->first)) ? lo + 1 : lo;
+    return std::make_pair(lo, hi);
+}
+
+/**
+* The lower bound, checked against the slot's copy of the key so that a
+* miss does not touch the item array.
+*/
+template<typename Key, typename Value>
+typename FrozenMap<Key, Value>::iterator
+FrozenMap<Key, Value>::find(const Key& key) const
+{
+    std::size_t slot = descend<false>(key);
+    if(slot == 0 || key < keyAt(slot)) {
+        return end();
+    }
+    return begin() + positions_[slot];
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value>
+Value const & FrozenMap<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the FrozenMap class.
+  ---------------------------------------------
+*/
+
+/**
+* A read-only snapshot of tree (any BinarySearchTree, including AVLTree
+* and its derived trees). Later changes to tree do not affect it.
+*/
+template<typename Key, typename Value, typename Alloc, typename Stats>
+FrozenMap<Key, Value> freeze(const BinarySearchTree<Key, Value, Alloc, Stats>& tree)
+{
+    return FrozenMap<Key, Value>(tree.begin(), tree.end());
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <stdexcept>
+#include "indexed_avl.h"
+
+using namespace std;
+
+// A value whose copies are counted, and whose copy throws when a
+// countdown reaches zero
+struct FragileValue
+{
+    FragileValue(int v) : value(v) { ++alive; }
+    FragileValue(const FragileValue& other) : value(other.value)
+    {
+        if(countdown > 0 && --countdown == 0) {
+            throw runtime_error("copy refused");
+        }
+        ++alive;
+    }
+    ~FragileValue() { --alive; }
+
+    int value;
+    static int countdown;
+    static int alive;
+};
+int FragileValue::countdown = 0;
+int FragileValue::alive = 0;
+
+
+int main(int argc, char *argv[])
+{
+    // Same calls as the BinarySearchTree tests
+    IndexedAVLTree<char,int> it;
+    it.insert(std::make_pair('a',1));
+    it.insert(std::make_pair('b',2));
+
+    cout << "IndexedAVLTree contents:" << endl;
+    for(IndexedAVLTree<char,int>::iterator i = it.begin(); i != it.end(); ++i) {
+        cout << i->first << " " << i->second << endl;
+    }
+    if(it.find('b') != it.end()) {
+        cout << "Found b" << endl;
+    }
+    else {
+        cout << "Did not find b" << endl;
+    }
+    cout << "Erasing b" << endl;
+    it.remove('b');
+
+    // Random inserts and removes checked against std::map
+    IndexedAVLTree<string,int> st;
+    map<string,int> expected;
+    srand(1);
+    for(int i = 0; i < 50000; ++i) {
+        string key = to_string(rand() % 5000);
+        if(rand() % 3 != 0) {
+            st.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        else {
+            st.remove(key);
+            expected.erase(key);
+        }
+    }
+
+    bool same = (st.size() == expected.size());
+    IndexedAVLTree<string,int>::iterator sit = st.begin();
+    for(map<string,int>::iterator ex = expected.begin(); same && ex != expected.end(); ++ex, ++sit) {
+        same = (sit != st.end() && sit->first == ex->first && sit->second == ex->second);
+    }
+    cout << "\nIndexedAVLTree matches std::map after 50000 operations: " << (same && sit == st.end()) << endl;
+    cout << "Balanced: " << st.isBalanced() << endl;
+
+    // Sorted bulk load, bounds and reverse iteration
+    vector<pair<int,int> > sorted;
+    for(int i = 0; i < 1000; ++i) {
+        sorted.push_back(make_pair(i * 2, i));
+    }
+    IndexedAVLTree<int,int> bt(sorted.begin(), sorted.end());
+    cout << "Bulk loaded " << bt.size() << ", lower_bound(501): " << bt.lower_bound(501)->first
+         << ", largest: " << bt.rbegin()->first << endl;
+
+    // A sorted bulk load whose copy throws part way leaves the tree empty
+    IndexedAVLTree<int,FragileValue> fragile;
+    vector<pair<int,FragileValue> > fragileItems;
+    for(int i = 0; i < 1000; ++i) {
+        fragileItems.push_back(make_pair(i, FragileValue(i)));
+    }
+    int before = FragileValue::alive;
+    FragileValue::countdown = 500;
+    try {
+        fragile.assign(fragileItems.begin(), fragileItems.end());
+    }
+    catch(const runtime_error&) {
+    }
+    FragileValue::countdown = 0;
+    cout << "Failed assign leaves an empty tree: "
+         << (fragile.size() == 0 && fragile.empty() && fragile.begin() == fragile.end())
+         << ", no values left alive: " << (FragileValue::alive == before) << endl;
+
+    // Copies are deep, free slots and all; moves leave the source empty
+    IndexedAVLTree<string,int> copied;
+    copied.insert(make_pair(string("stale"), 0));
+    copied = st;
+    IndexedAVLTree<string,int> moved(std::move(st));
+    st = copied;
+    st.remove(copied.begin()->first);
+    st.insert(make_pair(string("fresh"), 1));
+    bool copySame = (copied.size() == expected.size() && moved.size() == expected.size());
+    IndexedAVLTree<string,int>::iterator cit = copied.begin();
+    IndexedAVLTree<string,int>::iterator mit = moved.begin();
+    for(map<string,int>::iterator ex = expected.begin(); copySame && ex != expected.end(); ++ex, ++cit, ++mit) {
+        copySame = (cit->first == ex->first && cit->second == ex->second &&
+                    mit->first == ex->first && mit->second == ex->second);
+    }
+    cout << "Copy and move assignment match std::map: " << copySame
+         << ", copy changed independently: " << (st.size() == expected.size() && st.find("fresh") != st.end()
+                                                  && copied.find("fresh") == copied.end()) << endl;
+
+    st.clear();
+    cout << "Cleared, empty: " << st.empty() << endl;
+}
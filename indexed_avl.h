@@ -0,0 +1,1380 @@
+#ifndef INDEXED_AVL_H
+#define INDEXED_AVL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// See bst.h
+#ifndef BST_PREFETCH
+#if defined(__GNUC__)
+#define BST_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BST_PREFETCH(addr) ((void)0)
+#endif
+#endif
+
+/**
+* An AVL tree with the same surface as AVLTree (insert, emplace,
+* try_emplace, remove, find, find_batch, operator[], bounds, ranges and
+* bidirectional iterators), whose nodes all live in one std::vector and
+* link to each other by 32-bit index instead of by pointer.
+*
+* A node is its item, three 32-bit links and the balance: 24 bytes for an
+* int/int tree against 40 for an AVLNode, with no per-node allocation.
+* A removed node's slot goes on a free list for later inserts to reuse,
+* so memory is the most items the tree has held at once plus the
+* vector's spare capacity, and a sorted bulk load lays the nodes out in
+* key order.
+*
+* The price is std::vector's invalidation rules rather than a node
+* tree's: insert may move items, invalidating references and pointers to
+* them (iterators, being indices, stay valid). remove invalidates only
+* what refers to the removed item. At most 2^32 - 2 items.
+*/
+template <typename Key, typename Value>
+class IndexedAVLTree
+{
+public:
+    class iterator;
+    class const_iterator;
+    class Range;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    IndexedAVLTree();
+    IndexedAVLTree(const IndexedAVLTree& other);
+    IndexedAVLTree(IndexedAVLTree&& other);
+    IndexedAVLTree& operator=(IndexedAVLTree other);
+    template<typename ForwardIt>
+    IndexedAVLTree(ForwardIt first, ForwardIt last);
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+
+    std::pair<iterator, bool> insert(const std::pair<const Key, Value>& keyValuePair);
+    std::pair<iterator, bool> insert(std::pair<const Key, Value>&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    void remove(const Key& key);
+    void clear();
+    void swap(IndexedAVLTree& other);
+    void reserve(std::size_t n);
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    iterator find(const Key& key) const;
+    void find_batch(const std::vector<Key>& keys, std::vector<iterator>& out) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    Range range(const Key& lo, const Key& hi) const;
+
+protected:
+    typedef std::pair<const Key, Value> Item;
+
+    // The "null" link
+    static const uint32_t NIL = 0xFFFFFFFFu;
+    // Descents find_batch() keeps in flight at once
+    static const std::size_t FIND_BATCH_GROUP = 16;
+
+    // Indices into Slot::child
+    static const int LEFT = 0;
+    static const int RIGHT = 1;
+    // Slot::balance of a slot on the free list
+    static const int8_t FREE = -128;
+
+    /**
+    * A node. The item lives in raw storage so that a slot can outlive it
+    * on the free list and take a new one without the slot itself being
+    * destroyed and recreated.
+    */
+    struct Slot
+    {
+        template<typename... Args>
+        Slot(uint32_t parentIndex, Args&&... args) :
+            parent(parentIndex), balance(0)
+        {
+            new (&storage) Item(std::forward<Args>(args)...);
+            child[LEFT] = NIL;
+            child[RIGHT] = NIL;
+        }
+        Slot(const Slot& other) :
+            parent(other.parent), balance(other.balance)
+        {
+            if(other.balance != FREE) {
+                new (&storage) Item(other.item());
+            }
+            child[LEFT] = other.child[LEFT];
+            child[RIGHT] = other.child[RIGHT];
+        }
+        Slot(Slot&& other) noexcept(std::is_nothrow_move_constructible<Item>::value) :
+            parent(other.parent), balance(other.balance)
+        {
+            if(other.balance != FREE) {
+                new (&storage) Item(std::move(other.item()));
+            }
+            child[LEFT] = other.child[LEFT];
+            child[RIGHT] = other.child[RIGHT];
+        }
+        Slot& operator=(const Slot&) = delete;
+        ~Slot()
+        {
+            if(balance != FREE) {
+                item().~Item();
+            }
+        }
+
+        Item& item()
+        {
+#ifdef __cpp_lib_launder
+            return *std::launder(reinterpret_cast<Item*>(&storage));
+#else
+            return *reinterpret_cast<Item*>(&storage);
+#endif
+        }
+        const Item& item() const
+        {
+            return const_cast<Slot*>(this)->item();
+        }
+
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage;
+        uint32_t parent;    // the next free slot, while on the free list
+        uint32_t child[2];  // an array so a descent can index it with a comparison
+        int8_t balance;     // height(right) - height(left), or FREE
+    };
+
+    uint32_t findIndex(const Key& key) const;
+    uint32_t findInsertPoint(const Key& key, uint32_t& parent, bool& isLeft) const;
+    template<typename... Args>
+    uint32_t createSlot(uint32_t parent, Args&&... args);
+    void linkSlot(uint32_t node, uint32_t parent, bool isLeft);
+    void releaseSlot(uint32_t node);
+    void swapPositions(uint32_t node, uint32_t other);
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+    uint32_t rotateLeft(uint32_t node);
+    uint32_t rotateRight(uint32_t node);
+    void insertFix(uint32_t child, uint32_t parent);
+    void removeFix(uint32_t node, bool shrankLeft);
+    template<typename ForwardIt>
+    uint32_t buildSorted(ForwardIt& it, std::size_t n, int& height);
+    int heightIfBalanced(uint32_t node) const;
+    uint32_t smallest(uint32_t node) const;
+    uint32_t largest(uint32_t node) const;
+    uint32_t next(uint32_t node) const;
+    uint32_t prev(uint32_t node) const;
+    iterator iteratorAt(uint32_t node) const;
+
+    std::vector<Slot> nodes_;
+    uint32_t root_;
+    uint32_t free_;     // the first slot on the free list, or NIL
+    std::size_t size_;
+
+public:
+    // Bytes per item, for comparing with the node based trees
+    static const std::size_t NODE_BYTES = sizeof(Slot);
+
+    /**
+    * A bidirectional iterator: the index of an item and the tree it is
+    * in. --end() is the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class IndexedAVLTree<Key, Value>;
+        iterator(uint32_t index, const IndexedAVLTree* tree);
+        uint32_t index_;
+        const IndexedAVLTree* tree_;
+    };
+
+    /**
+    * A read-only view of an iterator.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+        friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.it_ == rhs.it_; }
+        friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return lhs.it_ != rhs.it_; }
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+    private:
+        iterator it_;
+    };
+
+    /**
+    * The items with lo <= key < hi, as returned by range().
+    */
+    class Range
+    {
+    public:
+        Range(iterator first, iterator last) : first_(first), last_(last) {}
+        iterator begin() const { return first_; }
+        iterator end() const { return last_; }
+        bool empty() const { return first_ == last_; }
+    private:
+        iterator first_;
+        iterator last_;
+    };
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the IndexedAVLTree iterator classes.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::iterator::iterator() :
+    index_(NIL),
+    tree_(nullptr)
+{
+
+}
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::iterator::iterator(uint32_t index, const IndexedAVLTree* tree) :
+    index_(index),
+    tree_(tree)
+{
+
+}
+
+/**
+* Iterators hand out mutable values even from a const tree, as the node
+* based trees' iterators do.
+*/
+template<typename Key, typename Value>
+std::pair<const Key, Value>&
+IndexedAVLTree<Key, Value>::iterator::operator*() const
+{
+    return const_cast<IndexedAVLTree*>(tree_)->nodes_[index_].item();
+}
+
+template<typename Key, typename Value>
+std::pair<const Key, Value>*
+IndexedAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(**this);
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator&
+IndexedAVLTree<Key, Value>::iterator::operator++()
+{
+    index_ = tree_->next(index_);
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator&
+IndexedAVLTree<Key, Value>::iterator::operator--()
+{
+    if(index_ == NIL) {
+        index_ = tree_->largest(tree_->root_);
+    }
+    else {
+        index_ = tree_->prev(index_);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::const_iterator::const_iterator()
+{
+
+}
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
+{
+
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key, Value>&
+IndexedAVLTree<Key, Value>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<typename Key, typename Value>
+const std::pair<const Key, Value>*
+IndexedAVLTree<Key, Value>::const_iterator::operator->() const
+{
+    return &(*it_);
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator&
+IndexedAVLTree<Key, Value>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator
+IndexedAVLTree<Key, Value>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++it_;
+    return old;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator&
+IndexedAVLTree<Key, Value>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator
+IndexedAVLTree<Key, Value>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --it_;
+    return old;
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the IndexedAVLTree iterator classes.
+  ---------------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the IndexedAVLTree class.
+  ---------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::IndexedAVLTree() :
+    root_(NIL), free_(NIL), size_(0)
+{
+
+}
+
+/**
+* Copies the nodes as they lie, free slots included, so that the copy's
+* indices match other's.
+*/
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::IndexedAVLTree(const IndexedAVLTree& other) :
+    nodes_(other.nodes_), root_(other.root_), free_(other.free_), size_(other.size_)
+{
+
+}
+
+/**
+* Takes other's nodes, leaving it empty.
+*/
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>::IndexedAVLTree(IndexedAVLTree&& other) :
+    root_(NIL), free_(NIL), size_(0)
+{
+    swap(other);
+}
+
+/**
+* Copy and move assignment: other is built by the copy or move
+* constructor, so a copy that throws leaves this tree as it was.
+*/
+template<typename Key, typename Value>
+IndexedAVLTree<Key, Value>& IndexedAVLTree<Key, Value>::operator=(IndexedAVLTree other)
+{
+    swap(other);
+    return *this;
+}
+
+/**
+* Constructs the tree from the key/value pairs in [first, last).
+* See assign().
+*/
+template<typename Key, typename Value>
+template<typename ForwardIt>
+IndexedAVLTree<Key, Value>::IndexedAVLTree(ForwardIt first, ForwardIt last) :
+    root_(NIL), free_(NIL), size_(0)
+{
+    assign(first, last);
+}
+
+/**
+* Replaces the contents of the tree with the key/value pairs in
+* [first, last). Strictly increasing keys are built bottom-up in O(n),
+* with the nodes stored in key order; otherwise each pair is inserted,
+* later duplicates overwriting earlier ones. As AVLTree::assign(),
+* including leaving the tree empty if copying a pair throws.
+*/
+template<typename Key, typename Value>
+template<typename ForwardIt>
+void IndexedAVLTree<Key, Value>::assign(ForwardIt first, ForwardIt last)
+{
+    clear();
+    if(first == last) {
+        return;
+    }
+
+    bool sorted = true;
+    std::size_t n = 1;
+    ForwardIt prev = first;
+    for(ForwardIt it = std::next(first); it != last; ++it, ++prev, ++n) {
+        if(sorted && !(prev->first < it->first)) {
+            sorted = false;
+        }
+    }
+
+    if(!sorted) {
+        for(ForwardIt it = first; it != last; ++it) {
+            insert(*it);
+        }
+        return;
+    }
+
+    if(n >= NIL) {
+        throw std::length_error("IndexedAVLTree is full");
+    }
+    nodes_.reserve(n);
+    int height;
+    try {
+        root_ = buildSorted(first, n, height);
+    }
+    catch(...) {
+        clear();
+        throw;
+    }
+}
+
+/**
+* Builds a balanced subtree from the next n pairs of a sorted sequence,
+* appending each node after its left subtree, and reports its height.
+*/
+template<typename Key, typename Value>
+template<typename ForwardIt>
+uint32_t IndexedAVLTree<Key, Value>::buildSorted(ForwardIt& it, std::size_t n, int& height)
+{
+    if(n == 0) {
+        height = 0;
+        return NIL;
+    }
+
+    std::size_t leftCount = (n - 1) / 2;
+    int leftHeight, rightHeight;
+
+    uint32_t left = buildSorted(it, leftCount, leftHeight);
+    uint32_t current = createSlot(NIL, it->first, it->second);
+    ++it;
+    uint32_t right = buildSorted(it, n - 1 - leftCount, rightHeight);
+
+    Slot& slot = nodes_[current];
+    slot.child[LEFT] = left;
+    slot.child[RIGHT] = right;
+    if(left != NIL) {
+        nodes_[left].parent = current;
+    }
+    if(right != NIL) {
+        nodes_[right].parent = current;
+    }
+    slot.balance = static_cast<int8_t>(rightHeight - leftHeight);
+
+    height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+    return current;
+}
+
+/**
+* Inserts the pair, overwriting the value if the key is already present.
+* Returns an iterator to the item and whether a new item was added.
+*/
+template<typename Key, typename Value>
+std::pair<typename IndexedAVLTree<Key, Value>::iterator, bool>
+IndexedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    uint32_t parent;
+    bool isLeft;
+    uint32_t existing = findInsertPoint(keyValuePair.first, parent, isLeft);
+    if(existing != NIL) {
+        nodes_[existing].item().second = keyValuePair.second;
+        return std::make_pair(iteratorAt(existing), false);
+    }
+
+    uint32_t node = createSlot(parent, keyValuePair);
+    linkSlot(node, parent, isLeft);
+    return std::make_pair(iteratorAt(node), true);
+}
+
+template<typename Key, typename Value>
+std::pair<typename IndexedAVLTree<Key, Value>::iterator, bool>
+IndexedAVLTree<Key, Value>::insert(std::pair<const Key, Value>&& keyValuePair)
+{
+    uint32_t parent;
+    bool isLeft;
+    uint32_t existing = findInsertPoint(keyValuePair.first, parent, isLeft);
+    if(existing != NIL) {
+        nodes_[existing].item().second = std::move(keyValuePair.second);
+        return std::make_pair(iteratorAt(existing), false);
+    }
+
+    uint32_t node = createSlot(parent, std::move(keyValuePair));
+    linkSlot(node, parent, isLeft);
+    return std::make_pair(iteratorAt(node), true);
+}
+
+/**
+* Constructs the item in a new slot from args; if the key is already in
+* the tree its value is overwritten from it and the slot dropped again.
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+std::pair<typename IndexedAVLTree<Key, Value>::iterator, bool>
+IndexedAVLTree<Key, Value>::emplace(Args&&... args)
+{
+    uint32_t node = createSlot(NIL, std::forward<Args>(args)...);
+
+    uint32_t parent;
+    bool isLeft;
+    uint32_t existing = findInsertPoint(nodes_[node].item().first, parent, isLeft);
+    if(existing != NIL) {
+        nodes_[existing].item().second = std::move(nodes_[node].item().second);
+        releaseSlot(node);
+        return std::make_pair(iteratorAt(existing), false);
+    }
+
+    nodes_[node].parent = parent;
+    linkSlot(node, parent, isLeft);
+    return std::make_pair(iteratorAt(node), true);
+}
+
+/**
+* If key is not in the tree, inserts it with a value constructed from
+* args. If it is, nothing is constructed or overwritten.
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+std::pair<typename IndexedAVLTree<Key, Value>::iterator, bool>
+IndexedAVLTree<Key, Value>::try_emplace(const Key& key, Args&&... args)
+{
+    uint32_t parent;
+    bool isLeft;
+    uint32_t existing = findInsertPoint(key, parent, isLeft);
+    if(existing != NIL) {
+        return std::make_pair(iteratorAt(existing), false);
+    }
+
+    uint32_t node = createSlot(parent, std::piecewise_construct,
+                               std::forward_as_tuple(key),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+    linkSlot(node, parent, isLeft);
+    return std::make_pair(iteratorAt(node), true);
+}
+
+/**
+* Removes the item with the given key, if any. A node with two children
+* first trades places in the tree with its predecessor, so that it has at
+* most one child when it is unlinked; no item moves.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::remove(const Key& key)
+{
+    uint32_t node = findIndex(key);
+    if(node == NIL) {
+        return;
+    }
+
+    if(nodes_[node].child[LEFT] != NIL && nodes_[node].child[RIGHT] != NIL) {
+        swapPositions(node, largest(nodes_[node].child[LEFT]));
+    }
+
+    Slot& slot = nodes_[node];
+    uint32_t child = (slot.child[LEFT] != NIL) ? slot.child[LEFT] : slot.child[RIGHT];
+    uint32_t parent = slot.parent;
+    bool wasLeft = (parent != NIL && nodes_[parent].child[LEFT] == node);
+    if(child != NIL) {
+        nodes_[child].parent = parent;
+    }
+    replaceChild(parent, node, child);
+
+    if(parent != NIL) {
+        removeFix(parent, wasLeft);
+    }
+    releaseSlot(node);
+}
+
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::clear()
+{
+    nodes_.clear();
+    root_ = NIL;
+    free_ = NIL;
+    size_ = 0;
+}
+
+/**
+* Exchanges the contents of the two trees in O(1). Iterators stay with
+* the tree they were made from, so both trees' iterators are invalidated.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::swap(IndexedAVLTree& other)
+{
+    nodes_.swap(other.nodes_);
+    std::swap(root_, other.root_);
+    std::swap(free_, other.free_);
+    std::swap(size_, other.size_);
+}
+
+/**
+* Makes room for n items, so that inserting up to n moves nothing.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::reserve(std::size_t n)
+{
+    nodes_.reserve(n);
+}
+
+/**
+* Checks the AVL property and that every stored balance and parent link
+* is right. Recursion depth is the tree's height.
+*/
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::isBalanced() const
+{
+    return (root_ == NIL || nodes_[root_].parent == NIL) && heightIfBalanced(root_) >= 0;
+}
+
+template<typename Key, typename Value>
+bool IndexedAVLTree<Key, Value>::empty() const
+{
+    return root_ == NIL;
+}
+
+template<typename Key, typename Value>
+std::size_t IndexedAVLTree<Key, Value>::size() const
+{
+    return size_;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::begin() const
+{
+    return iteratorAt(smallest(root_));
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::end() const
+{
+    return iteratorAt(NIL);
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator
+IndexedAVLTree<Key, Value>::cbegin() const
+{
+    return const_iterator(begin());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_iterator
+IndexedAVLTree<Key, Value>::cend() const
+{
+    return const_iterator(end());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::reverse_iterator
+IndexedAVLTree<Key, Value>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::reverse_iterator
+IndexedAVLTree<Key, Value>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_reverse_iterator
+IndexedAVLTree<Key, Value>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::const_reverse_iterator
+IndexedAVLTree<Key, Value>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iteratorAt(findIndex(key));
+}
+
+/**
+* Sets out[i] to find(keys[i]) for every key, interleaving the descents
+* and prefetching each one's next node. See BinarySearchTree::find_batch().
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::find_batch(const std::vector<Key>& keys, std::vector<iterator>& out) const
+{
+    out.assign(keys.size(), end());
+
+    uint32_t cursor[FIND_BATCH_GROUP];
+    std::size_t slot[FIND_BATCH_GROUP];
+    std::size_t active = 0;
+    std::size_t next = 0;
+    while(active < FIND_BATCH_GROUP && next < keys.size()) {
+        cursor[active] = root_;
+        slot[active++] = next++;
+    }
+
+    while(active > 0) {
+        for(std::size_t i = 0; i < active; ) {
+            uint32_t node = cursor[i];
+            const Key& key = keys[slot[i]];
+
+            if(node != NIL) {
+                const Slot& current = nodes_[node];
+                bool right = current.item().first < key;
+                if(!right && !(key < current.item().first)) { //Found; a miss keeps the end() set above
+                    out[slot[i]] = iteratorAt(node);
+                    node = NIL;
+                }
+                else { //Go down one level
+                    node = current.child[right];
+                }
+                if(node != NIL) {
+                    BST_PREFETCH(&nodes_[node]);
+                    cursor[i++] = node;
+                    continue;
+                }
+            }
+
+            if(next < keys.size()) { //Start the next key in this slot
+                cursor[i] = root_;
+                slot[i++] = next++;
+            }
+            else { //Nothing left to start: move the last descent here
+                --active;
+                cursor[i] = cursor[active];
+                slot[i] = slot[active];
+            }
+        }
+    }
+}
+
+/**
+* @precondition The key exists in the map
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value>
+Value& IndexedAVLTree<Key, Value>::operator[](const Key& key)
+{
+    uint32_t node = findIndex(key);
+    if(node == NIL) throw std::out_of_range("Invalid key");
+    return nodes_[node].item().second;
+}
+
+template<typename Key, typename Value>
+Value const & IndexedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    uint32_t node = findIndex(key);
+    if(node == NIL) throw std::out_of_range("Invalid key");
+    return nodes_[node].item().second;
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end().
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::lower_bound(const Key& key) const
+{
+    uint32_t result = NIL;
+    uint32_t itr = root_;
+    while(itr != NIL) {
+        if(nodes_[itr].item().first < key) {
+            itr = nodes_[itr].child[RIGHT];
+        }
+        else {
+            result = itr;
+            itr = nodes_[itr].child[LEFT];
+        }
+    }
+    return iteratorAt(result);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end().
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::upper_bound(const Key& key) const
+{
+    uint32_t result = NIL;
+    uint32_t itr = root_;
+    while(itr != NIL) {
+        if(key < nodes_[itr].item().first) {
+            result = itr;
+            itr = nodes_[itr].child[LEFT];
+        }
+        else {
+            itr = nodes_[itr].child[RIGHT];
+        }
+    }
+    return iteratorAt(result);
+}
+
+template<typename Key, typename Value>
+std::pair<typename IndexedAVLTree<Key, Value>::iterator, typename IndexedAVLTree<Key, Value>::iterator>
+IndexedAVLTree<Key, Value>::equal_range(const Key& key) const
+{
+    iterator first = lower_bound(key);
+    iterator last = first;
+    if(last != end() && !(key < last->first)) {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* The items with lo <= key < hi; empty unless lo < hi.
+*/
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::Range
+IndexedAVLTree<Key, Value>::range(const Key& lo, const Key& hi) const
+{
+    if(!(lo < hi)) {
+        return Range(end(), end());
+    }
+    return Range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* The direction taken at each level is a coin toss, so rather than
+* branching on it the child is loaded by indexing with the comparison;
+* the only branch is the rarely taken one for a match.
+*/
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::findIndex(const Key& key) const
+{
+    uint32_t itr = root_;
+    while(itr != NIL) {
+        const Slot& current = nodes_[itr];
+        bool right = current.item().first < key;
+        if(!right && !(key < current.item().first)) {
+            return itr;
+        }
+        itr = current.child[right];
+    }
+    return NIL;
+}
+
+/**
+* Returns the node holding key, or NIL with parent and isLeft set to
+* where a node for key would be linked.
+*/
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::findInsertPoint(const Key& key, uint32_t& parent, bool& isLeft) const
+{
+    parent = NIL;
+    isLeft = false;
+    uint32_t itr = root_;
+    while(itr != NIL) {
+        const Slot& current = nodes_[itr];
+        if(key < current.item().first) {
+            parent = itr;
+            isLeft = true;
+            itr = current.child[LEFT];
+        }
+        else if(current.item().first < key) {
+            parent = itr;
+            isLeft = false;
+            itr = current.child[RIGHT];
+        }
+        else {
+            return itr;
+        }
+    }
+    return NIL;
+}
+
+/**
+* Takes a slot off the free list, or appends one, for an unlinked node
+* whose item is built from args. If building the item throws, the free
+* slot stays free.
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+uint32_t IndexedAVLTree<Key, Value>::createSlot(uint32_t parent, Args&&... args)
+{
+    uint32_t node = free_;
+    if(node != NIL) {
+        Slot& slot = nodes_[node];
+        new (&slot.storage) Item(std::forward<Args>(args)...);
+        free_ = slot.parent;
+        slot.parent = parent;
+        slot.child[LEFT] = NIL;
+        slot.child[RIGHT] = NIL;
+        slot.balance = 0;
+    }
+    else {
+        if(nodes_.size() >= NIL - 1) {
+            throw std::length_error("IndexedAVLTree is full");
+        }
+        nodes_.emplace_back(parent, std::forward<Args>(args)...);
+        node = static_cast<uint32_t>(nodes_.size() - 1);
+    }
+    ++size_;
+    return node;
+}
+
+/**
+* Hangs a new leaf under parent and rebalances.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::linkSlot(uint32_t node, uint32_t parent, bool isLeft)
+{
+    if(parent == NIL) {
+        root_ = node;
+        return;
+    }
+    if(isLeft) {
+        nodes_[parent].child[LEFT] = node;
+    }
+    else {
+        nodes_[parent].child[RIGHT] = node;
+    }
+    insertFix(node, parent);
+}
+
+/**
+* Destroys the item of an unlinked node. The last slot is dropped from
+* the vector; any other goes on the free list.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::releaseSlot(uint32_t node)
+{
+    --size_;
+    if(node == nodes_.size() - 1) {
+        nodes_.pop_back();
+        return;
+    }
+    Slot& slot = nodes_[node];
+    slot.item().~Item();
+    slot.balance = FREE;
+    slot.parent = free_;
+    free_ = node;
+}
+
+/**
+* Exchanges the places of two nodes in the tree: their links, their
+* neighbours' links to them and their balances. The items stay where they
+* are, as with BinarySearchTree::nodeSwap().
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::swapPositions(uint32_t node, uint32_t other)
+{
+    uint32_t const ends[2] = {node, other};
+
+    // Point the outside neighbours at the new places first
+    if(nodes_[node].parent == nodes_[other].parent) {
+        Slot& parent = nodes_[nodes_[node].parent];
+        std::swap(parent.child[LEFT], parent.child[RIGHT]);
+    }
+    else {
+        for(int i = 0; i < 2; i++) {
+            if(nodes_[ends[i]].parent != ends[1 - i]) {
+                replaceChild(nodes_[ends[i]].parent, ends[i], ends[1 - i]);
+            }
+        }
+    }
+    for(int i = 0; i < 2; i++) {
+        for(int side = LEFT; side <= RIGHT; side++) {
+            uint32_t child = nodes_[ends[i]].child[side];
+            if(child != NIL && child != ends[1 - i]) {
+                nodes_[child].parent = ends[1 - i];
+            }
+        }
+    }
+
+    Slot& a = nodes_[node];
+    Slot& b = nodes_[other];
+    std::swap(a.parent, b.parent);
+    std::swap(a.child[LEFT], b.child[LEFT]);
+    std::swap(a.child[RIGHT], b.child[RIGHT]);
+    std::swap(a.balance, b.balance);
+
+    // Where one was the other's parent, the swapped links point at itself
+    for(int i = 0; i < 2; i++) {
+        Slot& slot = nodes_[ends[i]];
+        if(slot.parent == ends[i]) {
+            slot.parent = ends[1 - i];
+        }
+        for(int side = LEFT; side <= RIGHT; side++) {
+            if(slot.child[side] == ends[i]) {
+                slot.child[side] = ends[1 - i];
+            }
+        }
+    }
+}
+
+/**
+* Points parent's link to oldChild (or root_, if parent is NIL) at
+* newChild.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if(parent == NIL) {
+        root_ = newChild;
+    }
+    else if(nodes_[parent].child[LEFT] == oldChild) {
+        nodes_[parent].child[LEFT] = newChild;
+    }
+    else {
+        nodes_[parent].child[RIGHT] = newChild;
+    }
+}
+
+/**
+* Rotates node's right child up into its place and returns it. Balances
+* are left to the caller.
+*/
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::rotateLeft(uint32_t node)
+{
+    uint32_t child = nodes_[node].child[RIGHT];
+    uint32_t inner = nodes_[child].child[LEFT];
+    uint32_t parent = nodes_[node].parent;
+
+    nodes_[node].child[RIGHT] = inner;
+    if(inner != NIL) {
+        nodes_[inner].parent = node;
+    }
+    nodes_[child].child[LEFT] = node;
+    nodes_[node].parent = child;
+    nodes_[child].parent = parent;
+    replaceChild(parent, node, child);
+    return child;
+}
+
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::rotateRight(uint32_t node)
+{
+    uint32_t child = nodes_[node].child[LEFT];
+    uint32_t inner = nodes_[child].child[RIGHT];
+    uint32_t parent = nodes_[node].parent;
+
+    nodes_[node].child[LEFT] = inner;
+    if(inner != NIL) {
+        nodes_[inner].parent = node;
+    }
+    nodes_[child].child[RIGHT] = node;
+    nodes_[node].parent = child;
+    nodes_[child].parent = parent;
+    replaceChild(parent, node, child);
+    return child;
+}
+
+/**
+* child's subtree just grew by one level under parent. Walks up adjusting
+* balances until a node absorbs the growth or one rotation restores it,
+* as AVLTree::insertFix() does.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::insertFix(uint32_t child, uint32_t parent)
+{
+    while(parent != NIL) {
+        Slot& node = nodes_[parent];
+        int balance = node.balance + ((node.child[LEFT] == child) ? -1 : 1);
+
+        if(balance == 0) {
+            node.balance = 0;
+            return;
+        }
+        if(balance == 1 || balance == -1) {
+            node.balance = static_cast<int8_t>(balance);
+            child = parent;
+            parent = node.parent;
+            continue;
+        }
+
+        int8_t side = (balance > 0) ? 1 : -1;
+        if(nodes_[child].balance == side) { //Zig-zig
+            if(side > 0) {
+                rotateLeft(parent);
+            }
+            else {
+                rotateRight(parent);
+            }
+            nodes_[parent].balance = 0;
+            nodes_[child].balance = 0;
+        }
+        else { //Zig-zag
+            uint32_t grandchild = (side > 0) ? nodes_[child].child[LEFT] : nodes_[child].child[RIGHT];
+            if(side > 0) {
+                rotateRight(child);
+                rotateLeft(parent);
+            }
+            else {
+                rotateLeft(child);
+                rotateRight(parent);
+            }
+            int8_t grandBalance = nodes_[grandchild].balance;
+            nodes_[parent].balance = (grandBalance == side) ? static_cast<int8_t>(-side) : 0;
+            nodes_[child].balance = (grandBalance == -side) ? side : 0;
+            nodes_[grandchild].balance = 0;
+        }
+        return;
+    }
+}
+
+/**
+* node's left (shrankLeft) or right subtree just lost a level. Walks up
+* adjusting balances and rotating until the height change is absorbed,
+* as AVLTree::removeFix() does.
+*/
+template<typename Key, typename Value>
+void IndexedAVLTree<Key, Value>::removeFix(uint32_t node, bool shrankLeft)
+{
+    while(node != NIL) {
+        int balance = nodes_[node].balance + (shrankLeft ? 1 : -1);
+        uint32_t top = node;
+
+        if(balance == 1 || balance == -1) { //Height unchanged
+            nodes_[node].balance = static_cast<int8_t>(balance);
+            return;
+        }
+        if(balance == 0) {
+            nodes_[node].balance = 0;
+        }
+        else {
+            int8_t side = (balance > 0) ? 1 : -1;
+            uint32_t child = (side > 0) ? nodes_[node].child[RIGHT] : nodes_[node].child[LEFT];
+            int8_t childBalance = nodes_[child].balance;
+
+            if(childBalance != -side) { //Zig-zig
+                top = (side > 0) ? rotateLeft(node) : rotateRight(node);
+                if(childBalance == 0) { //Height unchanged
+                    nodes_[node].balance = side;
+                    nodes_[child].balance = static_cast<int8_t>(-side);
+                    return;
+                }
+                nodes_[node].balance = 0;
+                nodes_[child].balance = 0;
+            }
+            else { //Zig-zag
+                uint32_t grandchild = (side > 0) ? nodes_[child].child[LEFT] : nodes_[child].child[RIGHT];
+                if(side > 0) {
+                    rotateRight(child);
+                    top = rotateLeft(node);
+                }
+                else {
+                    rotateLeft(child);
+                    top = rotateRight(node);
+                }
+                int8_t grandBalance = nodes_[grandchild].balance;
+                nodes_[node].balance = (grandBalance == side) ? static_cast<int8_t>(-side) : 0;
+                nodes_[child].balance = (grandBalance == -side) ? side : 0;
+                nodes_[grandchild].balance = 0;
+            }
+        }
+
+        //The subtree under top is one level shorter: continue with its parent
+        uint32_t parent = nodes_[top].parent;
+        shrankLeft = (parent != NIL && nodes_[parent].child[LEFT] == top);
+        node = parent;
+    }
+}
+
+/**
+* Height of the subtree at node, or -1 if it breaks the AVL property or
+* has a wrong balance or parent link.
+*/
+template<typename Key, typename Value>
+int IndexedAVLTree<Key, Value>::heightIfBalanced(uint32_t node) const
+{
+    if(node == NIL) {
+        return 0;
+    }
+    const Slot& slot = nodes_[node];
+    if((slot.child[LEFT] != NIL && nodes_[slot.child[LEFT]].parent != node) ||
+       (slot.child[RIGHT] != NIL && nodes_[slot.child[RIGHT]].parent != node)) {
+        return -1;
+    }
+    int leftHeight = heightIfBalanced(slot.child[LEFT]);
+    int rightHeight = heightIfBalanced(slot.child[RIGHT]);
+    if(leftHeight < 0 || rightHeight < 0 || rightHeight - leftHeight != slot.balance ||
+       slot.balance < -1 || slot.balance > 1) {
+        return -1;
+    }
+    return 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+}
+
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::smallest(uint32_t node) const
+{
+    if(node == NIL) {
+        return NIL;
+    }
+    while(nodes_[node].child[LEFT] != NIL) {
+        node = nodes_[node].child[LEFT];
+    }
+    return node;
+}
+
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::largest(uint32_t node) const
+{
+    if(node == NIL) {
+        return NIL;
+    }
+    while(nodes_[node].child[RIGHT] != NIL) {
+        node = nodes_[node].child[RIGHT];
+    }
+    return node;
+}
+
+/**
+* The in-order successor of node, or NIL.
+*/
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::next(uint32_t node) const
+{
+    if(nodes_[node].child[RIGHT] != NIL) {
+        return smallest(nodes_[node].child[RIGHT]);
+    }
+    uint32_t parent = nodes_[node].parent;
+    while(parent != NIL && nodes_[parent].child[RIGHT] == node) {
+        node = parent;
+        parent = nodes_[node].parent;
+    }
+    return parent;
+}
+
+/**
+* The in-order predecessor of node, or NIL.
+*/
+template<typename Key, typename Value>
+uint32_t IndexedAVLTree<Key, Value>::prev(uint32_t node) const
+{
+    if(nodes_[node].child[LEFT] != NIL) {
+        return largest(nodes_[node].child[LEFT]);
+    }
+    uint32_t parent = nodes_[node].parent;
+    while(parent != NIL && nodes_[parent].child[LEFT] == node) {
+        node = parent;
+        parent = nodes_[node].parent;
+    }
+    return parent;
+}
+
+template<typename Key, typename Value>
+typename IndexedAVLTree<Key, Value>::iterator
+IndexedAVLTree<Key, Value>::iteratorAt(uint32_t node) const
+{
+    return iterator(node, this);
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the IndexedAVLTree class.
+  -------------------------------------------------
+*/
+
+#endif
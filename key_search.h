@@ -0,0 +1,326 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+* Searches within one node's sorted array of keys, as the wide nodes of
+* BTreeMap need:
+*
+*   KeySearch<Key>::lowerBound(keys, count, key)  keys less than key
+*   KeySearch<Key>::upperBound(keys, count, key)  keys not greater than key
+*
+* (both are also the index where the bound falls). For most key types
+* this is a branchless binary search. When the target has vector
+* instructions for Key (32-bit integers and float with SSE2, 64-bit
+* integers with SSE4.2, double with SSE2; twice as wide with AVX2), the
+* keys are instead compared against the search key a whole register at a
+* time and the matching lanes counted. For a node of 32 ints that is four
+* AVX2 compares with no dependent loads and no branch that depends on
+* the data.
+*
+* The choice is made at compile time from Key and the target flags:
+* x86-64 always has SSE2, -mavx2 or -march=native add the wider paths,
+* and on other targets every Key uses the scalar search.
+*/
+
+/**
+* Lanes describe one vector type: WIDTH keys per register, load(),
+* broadcast(), and greater(a, b), the bitmask of lanes where a > b.
+* Unsigned integers are compared as signed after flipping their top bit,
+* since the integer compares are signed only.
+*/
+#if defined(__SSE2__)
+
+template<typename Key>
+struct SseInt32Lanes
+{
+    typedef __m128i Vec;
+    static const int WIDTH = 4;
+    static Vec flip()
+    {
+        return _mm_set1_epi32(std::is_signed<Key>::value ? 0 : INT32_MIN);
+    }
+    static Vec load(const Key* keys)
+    {
+        return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)), flip());
+    }
+    static Vec broadcast(Key key)
+    {
+        return _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(key)), flip());
+    }
+    static unsigned greater(Vec a, Vec b)
+    {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a, b)));
+    }
+};
+
+struct SseFloatLanes
+{
+    typedef __m128 Vec;
+    static const int WIDTH = 4;
+    static Vec load(const float* keys) { return _mm_loadu_ps(keys); }
+    static Vec broadcast(float key) { return _mm_set1_ps(key); }
+    static unsigned greater(Vec a, Vec b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+};
+
+struct SseDoubleLanes
+{
+    typedef __m128d Vec;
+    static const int WIDTH = 2;
+    static Vec load(const double* keys) { return _mm_loadu_pd(keys); }
+    static Vec broadcast(double key) { return _mm_set1_pd(key); }
+    static unsigned greater(Vec a, Vec b) { return _mm_movemask_pd(_mm_cmpgt_pd(a, b)); }
+};
+
+#endif
+
+#if defined(__SSE4_2__)
+
+template<typename Key>
+struct SseInt64Lanes
+{
+    typedef __m128i Vec;
+    static const int WIDTH = 2;
+    static Vec flip()
+    {
+        return _mm_set1_epi64x(std::is_signed<Key>::value ? 0 : INT64_MIN);
+    }
+    static Vec load(const Key* keys)
+    {
+        return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)), flip());
+    }
+    static Vec broadcast(Key key)
+    {
+        return _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(key)), flip());
+    }
+    static unsigned greater(Vec a, Vec b)
+    {
+        return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(a, b)));
+    }
+};
+
+#endif
+
+#if defined(__AVX2__)
+
+template<typename Key>
+struct Avx2Int32Lanes
+{
+    typedef __m256i Vec;
+    static const int WIDTH = 8;
+    static Vec flip()
+    {
+        return _mm256_set1_epi32(std::is_signed<Key>::value ? 0 : INT32_MIN);
+    }
+    static Vec load(const Key* keys)
+    {
+        return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)), flip());
+    }
+    static Vec broadcast(Key key)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(key)), flip());
+    }
+    static unsigned greater(Vec a, Vec b)
+    {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, b)));
+    }
+};
+
+template<typename Key>
+struct Avx2Int64Lanes
+{
+    typedef __m256i Vec;
+    static const int WIDTH = 4;
+    static Vec flip()
+    {
+        return _mm256_set1_epi64x(std::is_signed<Key>::value ? 0 : INT64_MIN);
+    }
+    static Vec load(const Key* keys)
+    {
+        return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys)), flip());
+    }
+    static Vec broadcast(Key key)
+    {
+        return _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(key)), flip());
+    }
+    static unsigned greater(Vec a, Vec b)
+    {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(a, b)));
+    }
+};
+
+struct Avx2FloatLanes
+{
+    typedef __m256 Vec;
+    static const int WIDTH = 8;
+    static Vec load(const float* keys) { return _mm256_loadu_ps(keys); }
+    static Vec broadcast(float key) { return _mm256_set1_ps(key); }
+    static unsigned greater(Vec a, Vec b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+};
+
+struct Avx2DoubleLanes
+{
+    typedef __m256d Vec;
+    static const int WIDTH = 4;
+    static Vec load(const double* keys) { return _mm256_loadu_pd(keys); }
+    static Vec broadcast(double key) { return _mm256_set1_pd(key); }
+    static unsigned greater(Vec a, Vec b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ)); }
+};
+
+#endif
+
+/**
+* The widest lanes the target offers for Key, or void for none.
+*/
+template<typename Key, typename Enable = void>
+struct SimdLanes
+{
+    typedef void type;
+};
+
+// Integer keys of exactly 32 or 64 bits (not bool or char types)
+template<typename Key, int Bits>
+struct IsIntKey
+{
+    static const bool value = std::is_integral<Key>::value && !std::is_same<Key, bool>::value &&
+                              sizeof(Key) * 8 == Bits;
+};
+
+#if defined(__AVX2__)
+template<typename Key>
+struct SimdLanes<Key, typename std::enable_if<IsIntKey<Key, 32>::value>::type>
+{
+    typedef Avx2Int32Lanes<Key> type;
+};
+template<typename Key>
+struct SimdLanes<Key, typename std::enable_if<IsIntKey<Key, 64>::value>::type>
+{
+    typedef Avx2Int64Lanes<Key> type;
+};
+template<>
+struct SimdLanes<float>
+{
+    typedef Avx2FloatLanes type;
+};
+template<>
+struct SimdLanes<double>
+{
+    typedef Avx2DoubleLanes type;
+};
+#elif defined(__SSE2__)
+template<typename Key>
+struct SimdLanes<Key, typename std::enable_if<IsIntKey<Key, 32>::value>::type>
+{
+    typedef SseInt32Lanes<Key> type;
+};
+#if defined(__SSE4_2__)
+template<typename Key>
+struct SimdLanes<Key, typename std::enable_if<IsIntKey<Key, 64>::value>::type>
+{
+    typedef SseInt64Lanes<Key> type;
+};
+#endif
+template<>
+struct SimdLanes<float>
+{
+    typedef SseFloatLanes type;
+};
+template<>
+struct SimdLanes<double>
+{
+    typedef SseDoubleLanes type;
+};
+#endif
+
+inline int trailingZeros(unsigned mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int zeros = 0;
+    for(; (mask & 1) == 0; mask >>= 1) {
+        ++zeros;
+    }
+    return zeros;
+#endif
+}
+
+/**
+* Vectorized search: compares a register of keys at a time. The keys are
+* sorted, so in each register the lanes below key form a prefix and the
+* lanes above it a suffix, and counting them is finding the first lane
+* that differs, one bit scan (no popcount, which x86-64 does not have
+* before -mpopcnt). A tail of fewer than WIDTH keys is compared one by
+* one.
+*/
+template<typename Key, typename Lanes = typename SimdLanes<Key>::type>
+struct KeySearch
+{
+    static int lowerBound(const Key* keys, int count, const Key& key)
+    {
+        typename Lanes::Vec needle = Lanes::broadcast(key);
+        int i = 0;
+        int less = 0;
+        for(; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+            less += trailingZeros(~Lanes::greater(needle, Lanes::load(keys + i)));
+        }
+        for(; i < count; ++i) {
+            less += (keys[i] < key);
+        }
+        return less;
+    }
+
+    static int upperBound(const Key* keys, int count, const Key& key)
+    {
+        typename Lanes::Vec needle = Lanes::broadcast(key);
+        int i = 0;
+        int notGreater = 0;
+        for(; i + Lanes::WIDTH <= count; i += Lanes::WIDTH) {
+            notGreater += trailingZeros(Lanes::greater(Lanes::load(keys + i), needle) | (1u << Lanes::WIDTH));
+        }
+        for(; i < count; ++i) {
+            notGreater += !(key < keys[i]);
+        }
+        return notGreater;
+    }
+};
+
+/**
+* Scalar search: a binary search whose halving step is a conditional
+* move rather than a branch.
+*/
+template<typename Key>
+struct KeySearch<Key, void>
+{
+    static int lowerBound(const Key* keys, int count, const Key& key)
+    {
+        const Key* base = keys;
+        int len = count;
+        while(len > 1) {
+            int half = len / 2;
+            base = (base[half - 1] < key) ? base + half : base;
+            len -= half;
+        }
+        return static_cast<int>(base - keys) + (len == 1 && *base < key);
+    }
+
+    static int upperBound(const Key* keys, int count, const Key& key)
+    {
+        const Key* base = keys;
+        int len = count;
+        while(len > 1) {
+            int half = len / 2;
+            base = (key < base[half - 1]) ? base : base + half;
+            len -= half;
+        }
+        return static_cast<int>(base - keys) + (len == 1 && !(key < *base));
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <cstdlib>
+#include <stdexcept>
+#include "avlbst.h"
+#include "order_statistic.h"
+#include "stream_loader.h"
+
+using namespace std;
+
+// An OrderStatisticTree that counts the nodes whose counts it rebuilds
+// after a bulk load or a join, to show how much work loading costs
+struct CountingRankTree : public OrderStatisticTree<int,int>
+{
+    CountingRankTree() : recounted(0) {}
+    template<typename ForwardIt>
+    CountingRankTree(ForwardIt first, ForwardIt last) : recounted(0)
+    {
+        assign(first, last);
+    }
+
+    std::size_t recounted;
+
+protected:
+    virtual void restructured(AVLNode<int,int>* root)
+    {
+        recounted += nodesIn(root);
+        OrderStatisticTree<int,int>::restructured(root);
+    }
+    virtual void linked(AVLNode<int,int>* middle)
+    {
+        for(AVLNode<int,int>* n = middle; n != nullptr; n = n->getParent()) {
+            ++recounted;
+        }
+        OrderStatisticTree<int,int>::linked(middle);
+    }
+    static std::size_t nodesIn(AVLNode<int,int>* n)
+    {
+        return n == nullptr ? 0 : 1 + nodesIn(n->getLeft()) + nodesIn(n->getRight());
+    }
+};
+
+
+int main(int argc, char *argv[])
+{
+    // Sorted input takes the bulk load path batch after batch
+    ostringstream sortedText;
+    for(int i = 0; i < 10000; ++i) {
+        sortedText << i * 2 << " " << i << "\n";
+    }
+    istringstream sortedIn(sortedText.str());
+    AVLTree<int,int> at;
+    LoadStats stats = loadStream(at, sortedIn, 1000);
+    cout << "Sorted: " << stats.records << " records, " << stats.sortedBatches << " sorted batches, "
+         << stats.insertedBatches << " inserted batches" << endl;
+    cout << "Size " << at.size() << ", at[19998] = " << at[19998] << ", balanced: " << at.isBalanced() << endl;
+
+    // Joining each sorted batch must only recount the nodes along the
+    // join's path, not the whole tree, or a sorted file loads in
+    // quadratic time
+    ostringstream longText;
+    for(int i = 0; i < 100000; ++i) {
+        longText << i << " " << i << "\n";
+    }
+    istringstream longIn(longText.str());
+    CountingRankTree ct;
+    stats = loadStream(ct, longIn, 100);
+    cout << "\nSorted into an OrderStatisticTree: " << stats.sortedBatches << " sorted batches, "
+         << "fewer nodes recounted than loaded: " << (ct.recounted < ct.size())
+         << ", rank(54321): " << ct.rank(54321) << endl;
+
+    // Unsorted input with repeated keys, into a tree that already has
+    // items, checked against std::map
+    ostringstream mixedText;
+    map<int,int> expected;
+    OrderStatisticTree<int,int> rt;
+    for(int i = 0; i < 100; ++i) {
+        rt.insert(std::make_pair(i, -1));
+        expected[i] = -1;
+    }
+    srand(1);
+    for(int i = 0; i < 20000; ++i) {
+        int key = (i < 5000) ? 100 + i : rand() % 30000;
+        mixedText << key << " " << i << (i % 7 == 0 ? "\n" : "   ");
+        expected[key] = i;
+    }
+    istringstream mixedIn(mixedText.str());
+    stats = loadStream(rt, mixedIn, 5000);
+    bool same = (rt.size() == expected.size());
+    OrderStatisticTree<int,int>::iterator it = rt.begin();
+    for(map<int,int>::iterator ex = expected.begin(); same && ex != expected.end(); ++ex, ++it) {
+        same = (it->first == ex->first && it->second == ex->second);
+    }
+    cout << "\nMixed: " << stats.sortedBatches << " sorted batches, " << stats.insertedBatches
+         << " inserted batches, matches std::map: " << same << ", balanced: " << rt.isBalanced()
+         << ", rank(5000): " << rt.rank(5000) << endl;
+
+    // Throughput report
+    cout << "Report: ";
+    LoadStats example;
+    example.records = 10;
+    example.sortedBatches = 1;
+    example.seconds = 0.5;
+    example.print(cout);
+
+    istringstream badIn("-1 10\n-2 20\n-3 x\n");
+    try {
+        loadStream(at, badIn);
+    }
+    catch(const runtime_error& e) {
+        cout << "\nError: " << e.what() << ", records before it loaded: " << (at.size() == 10002) << endl;
+    }
+    try {
+        loadFile(at, "no-such-file.txt");
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+}
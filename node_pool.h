@@ -0,0 +1,245 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+* Node allocators for the search trees.
+*
+* A tree never calls new/delete on its nodes directly; it asks its allocator
+* to create() and destroy() them. An allocator must provide:
+*
+*   typedef ... node_type;                      // the concrete node class
+*   template<typename... Args>
+*   node_type* create(Args&&... args);          // allocate + construct
+*   void destroy(node_type* node);              // destruct + free
+*   void share(Alloc& other);                   // may now destroy other's nodes
+*
+* Allocators are owned by the tree and are not copyable.
+* Operations that move nodes from one tree to another (join, split, merge)
+* first call share() so that the receiving tree's allocator can destroy
+* them, and so that their memory lives as long as either tree does.
+*/
+
+/**
+* The default allocator: a slab/free-list arena. Nodes are carved out of
+* contiguous slabs, freed nodes are pushed on an intrusive free list and
+* recycled by the next create(), and every slab is released in one go when
+* the pool is destroyed.
+*/
+template <typename NodeType>
+class NodePool
+{
+public:
+    typedef NodeType node_type;
+
+    NodePool();
+    ~NodePool();
+
+    template<typename... Args>
+    NodeType* create(Args&&... args);
+    void destroy(NodeType* node);
+    void share(NodePool& other);
+
+private:
+    NodePool(const NodePool&);
+    NodePool& operator=(const NodePool&);
+
+    // A free block doubles as a free-list link.
+    union Block
+    {
+        Block* next;
+        alignas(NodeType) unsigned char storage[sizeof(NodeType)];
+    };
+
+    // Slabs are kept in reference-counted arenas: a pool allocates from
+    // its own arena, and keeps a reference to the arena of every pool it
+    // has exchanged nodes with. An arena is freed with its last pool.
+    struct Arena
+    {
+        ~Arena();
+        std::vector<Block*> slabs;
+    };
+
+    void grow();
+
+    static const std::size_t MIN_SLAB_BLOCKS = 64;
+    static const std::size_t MAX_SLAB_BLOCKS = 4096;
+
+    std::vector<std::shared_ptr<Arena> > arenas_;   // arenas_[0] is this pool's own
+    Block* freeList_;
+    Block* bump_;       // next never-used block in the newest slab
+    Block* bumpEnd_;
+    std::size_t nextSlabBlocks_;
+};
+
+/**
+* A plain heap allocator that does a new/delete per node. Useful as a
+* baseline, or when nodes must outlive the tree that created them.
+*/
+template <typename NodeType>
+class HeapNodeAllocator
+{
+public:
+    typedef NodeType node_type;
+
+    HeapNodeAllocator() {}
+
+    template<typename... Args>
+    NodeType* create(Args&&... args)
+    {
+        return new NodeType(std::forward<Args>(args)...);
+    }
+
+    void destroy(NodeType* node)
+    {
+        delete node;
+    }
+
+    // Heap nodes do not belong to any allocator
+    void share(HeapNodeAllocator& other) {}
+
+private:
+    HeapNodeAllocator(const HeapNodeAllocator&);
+    HeapNodeAllocator& operator=(const HeapNodeAllocator&);
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+template<typename NodeType>
+NodePool<NodeType>::NodePool() :
+    arenas_(1, std::make_shared<Arena>()),
+    freeList_(nullptr),
+    bump_(nullptr),
+    bumpEnd_(nullptr),
+    nextSlabBlocks_(MIN_SLAB_BLOCKS)
+{
+
+}
+
+/**
+* Drops this pool's arena references; arenas no other pool refers to
+* release their slabs. Nodes still alive at this point are not destructed;
+* the owning tree is responsible for destroying them first.
+*/
+template<typename NodeType>
+NodePool<NodeType>::~NodePool()
+{
+
+}
+
+template<typename NodeType>
+NodePool<NodeType>::Arena::~Arena()
+{
+    for(std::size_t i = 0; i < slabs.size(); ++i) {
+        ::operator delete(slabs[i]);
+    }
+}
+
+/**
+* Constructs a node in a recycled block if one is available, otherwise in
+* the next unused block of the newest slab.
+*/
+template<typename NodeType>
+template<typename... Args>
+NodeType* NodePool<NodeType>::create(Args&&... args)
+{
+    Block* block;
+    if(freeList_ != nullptr) {
+        block = freeList_;
+        freeList_ = block->next;
+    }
+    else {
+        if(bump_ == bumpEnd_) {
+            grow();
+        }
+        block = bump_++;
+    }
+
+    try {
+        return new (block->storage) NodeType(std::forward<Args>(args)...);
+    }
+    catch(...) {
+        block->next = freeList_;
+        freeList_ = block;
+        throw;
+    }
+}
+
+/**
+* Destructs a node and puts its block on the free list.
+*/
+template<typename NodeType>
+void NodePool<NodeType>::destroy(NodeType* node)
+{
+    if(node == nullptr) {
+        return;
+    }
+    node->~NodeType();
+    Block* block = reinterpret_cast<Block*>(node);
+    block->next = freeList_;
+    freeList_ = block;
+}
+
+/**
+* Makes nodes created by other safe to destroy through this pool: this
+* pool takes a reference to each of other's arenas, and adopts other's
+* free blocks. Costs O(arenas + free blocks in other).
+*/
+template<typename NodeType>
+void NodePool<NodeType>::share(NodePool& other)
+{
+    if(&other == this) {
+        return;
+    }
+    for(std::size_t i = 0; i < other.arenas_.size(); ++i) {
+        if(std::find(arenas_.begin(), arenas_.end(), other.arenas_[i]) == arenas_.end()) {
+            arenas_.push_back(other.arenas_[i]);
+        }
+    }
+    while(other.freeList_ != nullptr) {
+        Block* block = other.freeList_;
+        other.freeList_ = block->next;
+        block->next = freeList_;
+        freeList_ = block;
+    }
+}
+
+/**
+* Adds a new slab, doubling the slab size up to MAX_SLAB_BLOCKS so small
+* trees stay small and large trees need few slabs.
+*/
+template<typename NodeType>
+void NodePool<NodeType>::grow()
+{
+    std::vector<Block*>& slabs = arenas_[0]->slabs;
+    //Make room before allocating the slab, so push_back cannot throw and
+    //leak it; grow geometrically so adding slabs stays amortised O(1)
+    if(slabs.size() == slabs.capacity()) {
+        slabs.reserve(2 * slabs.size() + 1);
+    }
+    Block* slab = static_cast<Block*>(::operator new(nextSlabBlocks_ * sizeof(Block)));
+    slabs.push_back(slab);
+    bump_ = slab;
+    bumpEnd_ = slab + nextSlabBlocks_;
+    if(nextSlabBlocks_ < MAX_SLAB_BLOCKS) {
+        nextSlabBlocks_ *= 2;
+    }
+}
+
+/*
+  -------------------------------------------
+  End implementations for the NodePool class.
+  -------------------------------------------
+*/
+
+#endif
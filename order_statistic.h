@@ -0,0 +1,389 @@
+#ifndef ORDER_STATISTIC_H
+#define ORDER_STATISTIC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include "avlbst.h"
+
+/**
+* An AVLNode that also knows how many nodes are in its subtree.
+* The count fits in the padding after the balance, so the node is no
+* bigger than a plain AVLNode on common ABIs.
+*/
+template <typename Key, typename Value>
+class RankedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value>* parent);
+    template<typename... Args>
+    RankedAVLNode(RankedAVLNode<Key, Value>* parent, Args&&... args);
+
+    uint32_t getCount() const;
+    void setCount(uint32_t count);
+
+    // Hide the AVLNode versions, see the AVLNode class in avlbst.h.
+    RankedAVLNode<Key, Value>* getParent() const;
+    RankedAVLNode<Key, Value>* getLeft() const;
+    RankedAVLNode<Key, Value>* getRight() const;
+
+protected:
+    uint32_t count_;    // nodes in the subtree rooted here, including this one
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the RankedAVLNode class.
+  ------------------------------------------------
+*/
+
+template<class Key, class Value>
+RankedAVLNode<Key, Value>::RankedAVLNode(const Key& key, const Value& value, RankedAVLNode<Key, Value>* parent) :
+    AVLNode<Key, Value>(key, value, parent), count_(1)
+{
+
+}
+
+template<class Key, class Value>
+template<typename... Args>
+RankedAVLNode<Key, Value>::RankedAVLNode(RankedAVLNode<Key, Value>* parent, Args&&... args) :
+    AVLNode<Key, Value>(parent, std::forward<Args>(args)...), count_(1)
+{
+
+}
+
+template<class Key, class Value>
+uint32_t RankedAVLNode<Key, Value>::getCount() const
+{
+    return count_;
+}
+
+template<class Key, class Value>
+void RankedAVLNode<Key, Value>::setCount(uint32_t count)
+{
+    count_ = count;
+}
+
+template<class Key, class Value>
+RankedAVLNode<Key, Value>* RankedAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RankedAVLNode<Key, Value>* RankedAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RankedAVLNode<Key, Value>* RankedAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->right_);
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the RankedAVLNode class.
+  ----------------------------------------------
+*/
+
+/**
+* An AVLTree augmented with subtree sizes, for order-statistic queries:
+* select(k) finds the k-th smallest key and rank(key) counts the keys
+* smaller than key, both in O(log n).
+*
+* The counts are kept up to date by insert (every ancestor of the new
+* node gains one), remove (every ancestor of the unlinked node loses one),
+* nodeSwap (counts belong to positions, so they are swapped back) and the
+* two rotations (the two nodes that moved are recounted from their
+* children). Each update stays O(log n). Joins, and so split, join and
+* the set operations, recount only the nodes on the spine where they
+* hang the middle node, which they walk anyway, so they keep their
+* bounds; split is O(log n) here, since the root's count is the size.
+*
+* The counts are 32 bits, so the tree holds at most 2^32 - 1 items:
+* insert and assign throw std::length_error rather than go past that.
+* Joins and set operations do not check, so merging trees whose sizes
+* add up to more than that is not supported.
+*/
+template <class Key, class Value, class Alloc = NodePool<RankedAVLNode<Key, Value> > >
+class OrderStatisticTree : public AVLTree<Key, Value, Alloc>
+{
+    static_assert(std::is_base_of<RankedAVLNode<Key, Value>, typename Alloc::node_type>::value,
+                  "OrderStatisticTree requires an allocator of RankedAVLNodes");
+
+public:
+    typedef typename AVLTree<Key, Value, Alloc>::iterator iterator;
+
+    OrderStatisticTree();
+    template<typename ForwardIt>
+    OrderStatisticTree(ForwardIt first, ForwardIt last);
+
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+    iterator select(std::size_t k) const;
+    std::size_t rank(const Key& key) const;
+
+protected:
+    virtual void insertRebalance(Node<Key, Value>* node);
+    virtual void removeNode(AVLNode<Key, Value>* current);
+    virtual void nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2);
+    virtual void rotateLeft(AVLNode<Key, Value>* current);
+    virtual void rotateRight(AVLNode<Key, Value>* current);
+    virtual void restructured(AVLNode<Key, Value>* root);
+    virtual void linked(AVLNode<Key, Value>* middle);
+    virtual std::size_t countLower(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper, std::size_t total) const;
+
+    static uint32_t countOf(RankedAVLNode<Key, Value>* node);
+    static void recount(RankedAVLNode<Key, Value>* node);
+    static uint32_t recountSubtree(RankedAVLNode<Key, Value>* node);
+    RankedAVLNode<Key, Value>* rankedRoot() const;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the OrderStatisticTree class.
+  ------------------------------------------------------
+*/
+
+template<class Key, class Value, class Alloc>
+OrderStatisticTree<Key, Value, Alloc>::OrderStatisticTree() :
+    AVLTree<Key, Value, Alloc>()
+{
+
+}
+
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+OrderStatisticTree<Key, Value, Alloc>::OrderStatisticTree(ForwardIt first, ForwardIt last) :
+    AVLTree<Key, Value, Alloc>()
+{
+    this->assign(first, last);
+}
+
+/**
+* AVLTree::assign, refusing up front, with the tree unchanged, a range
+* longer than the counts can hold.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+void OrderStatisticTree<Key, Value, Alloc>::assign(ForwardIt first, ForwardIt last)
+{
+    if(static_cast<std::size_t>(std::distance(first, last)) > UINT32_MAX) {
+        throw std::length_error("OrderStatisticTree is limited to 2^32 - 1 items");
+    }
+    AVLTree<Key, Value, Alloc>::assign(first, last);
+}
+
+/**
+* Returns an iterator to the k-th smallest item (counting from 0), or
+* end() if k >= size().
+*/
+template<class Key, class Value, class Alloc>
+typename OrderStatisticTree<Key, Value, Alloc>::iterator
+OrderStatisticTree<Key, Value, Alloc>::select(std::size_t k) const
+{
+    RankedAVLNode<Key, Value>* itr = rankedRoot();
+    while(itr != nullptr) {
+        std::size_t leftCount = countOf(itr->getLeft());
+        if(k < leftCount) {
+            itr = itr->getLeft();
+        }
+        else if(k == leftCount) {
+            return this->iteratorAt(itr);
+        }
+        else {
+            k -= leftCount + 1;
+            itr = itr->getRight();
+        }
+    }
+    return this->end();
+}
+
+/**
+* Returns the number of keys in the tree that are smaller than key. key
+* itself need not be present.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t OrderStatisticTree<Key, Value, Alloc>::rank(const Key& key) const
+{
+    std::size_t smaller = 0;
+    RankedAVLNode<Key, Value>* itr = rankedRoot();
+    while(itr != nullptr) {
+        if(key < itr->getKey()) {
+            itr = itr->getLeft();
+        }
+        else if(itr->getKey() < key) {
+            smaller += countOf(itr->getLeft()) + 1;
+            itr = itr->getRight();
+        }
+        else {
+            return smaller + countOf(itr->getLeft());
+        }
+    }
+    return smaller;
+}
+
+/**
+* Counts the new leaf in each of its ancestors before the AVL fix-up, so
+* that the rotations it does start from correct counts. If the root's
+* count is already at its limit the leaf is unhung and destroyed again,
+* leaving the tree as it was, and std::length_error is thrown.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::insertRebalance(Node<Key, Value>* node)
+{
+    RankedAVLNode<Key, Value>* itr = static_cast<RankedAVLNode<Key, Value>*>(node)->getParent();
+    if(itr != nullptr && rankedRoot()->getCount() == UINT32_MAX) {
+        if(itr->getLeft() == node) {
+            itr->setLeft(nullptr);
+        }
+        else {
+            itr->setRight(nullptr);
+        }
+        this->destroyNode(node);
+        throw std::length_error("OrderStatisticTree is limited to 2^32 - 1 items");
+    }
+    while(itr != nullptr) {
+        itr->setCount(itr->getCount() + 1);
+        itr = itr->getParent();
+    }
+    AVLTree<Key, Value, Alloc>::insertRebalance(node);
+}
+
+/**
+* The node actually unlinked is current, or its predecessor if current
+* has two children (AVLTree::removeNode swaps them first). Uncounts it
+* from that position up before the AVL removal and fix-up.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::removeNode(AVLNode<Key, Value>* current)
+{
+    RankedAVLNode<Key, Value>* itr = static_cast<RankedAVLNode<Key, Value>*>(current);
+    if(itr->getLeft() != nullptr && itr->getRight() != nullptr) {
+        itr = static_cast<RankedAVLNode<Key, Value>*>(this->predecessor(itr));
+    }
+    while(itr != nullptr) {
+        itr->setCount(itr->getCount() - 1);
+        itr = itr->getParent();
+    }
+    AVLTree<Key, Value, Alloc>::removeNode(current);
+}
+
+/**
+* A count describes a position in the tree rather than an item, so it is
+* swapped back along with the balance.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::nodeSwap(AVLNode<Key, Value>* n1, AVLNode<Key, Value>* n2)
+{
+    AVLTree<Key, Value, Alloc>::nodeSwap(n1, n2);
+    RankedAVLNode<Key, Value>* r1 = static_cast<RankedAVLNode<Key, Value>*>(n1);
+    RankedAVLNode<Key, Value>* r2 = static_cast<RankedAVLNode<Key, Value>*>(n2);
+    uint32_t tempCount = r1->getCount();
+    r1->setCount(r2->getCount());
+    r2->setCount(tempCount);
+}
+
+/**
+* After a rotation current has moved down under its old child; recount
+* current first, then the child that took its place.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::rotateLeft(AVLNode<Key, Value>* current)
+{
+    AVLTree<Key, Value, Alloc>::rotateLeft(current);
+    RankedAVLNode<Key, Value>* node = static_cast<RankedAVLNode<Key, Value>*>(current);
+    recount(node);
+    recount(node->getParent());
+}
+
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::rotateRight(AVLNode<Key, Value>* current)
+{
+    AVLTree<Key, Value, Alloc>::rotateRight(current);
+    RankedAVLNode<Key, Value>* node = static_cast<RankedAVLNode<Key, Value>*>(current);
+    recount(node);
+    recount(node->getParent());
+}
+
+/**
+* A bulk load links nodes without going through insert, so their counts
+* are done in one pass over the new subtree.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::restructured(AVLNode<Key, Value>* root)
+{
+    recountSubtree(static_cast<RankedAVLNode<Key, Value>*>(root));
+}
+
+/**
+* The subtrees below middle kept their counts; middle and the spine
+* above it, up to the top of the subtree being joined, are recounted
+* bottom-up before the rotations, which then keep them right.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::linked(AVLNode<Key, Value>* middle)
+{
+    RankedAVLNode<Key, Value>* itr = static_cast<RankedAVLNode<Key, Value>*>(middle);
+    while(itr != nullptr) {
+        recount(itr);
+        itr = itr->getParent();
+    }
+}
+
+/**
+* A split's lower tree holds as many items as its root counts.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t OrderStatisticTree<Key, Value, Alloc>::countLower(AVLNode<Key, Value>* lower, AVLNode<Key, Value>* upper,
+                                                          std::size_t total) const
+{
+    return countOf(static_cast<RankedAVLNode<Key, Value>*>(lower));
+}
+
+template<class Key, class Value, class Alloc>
+uint32_t OrderStatisticTree<Key, Value, Alloc>::countOf(RankedAVLNode<Key, Value>* node)
+{
+    return (node == nullptr) ? 0 : node->getCount();
+}
+
+/**
+* Sets a node's count from its children's counts.
+*/
+template<class Key, class Value, class Alloc>
+void OrderStatisticTree<Key, Value, Alloc>::recount(RankedAVLNode<Key, Value>* node)
+{
+    node->setCount(1 + countOf(node->getLeft()) + countOf(node->getRight()));
+}
+
+/**
+* Recounts a whole subtree bottom-up and returns its count. Only used on
+* balanced trees, so recursing is safe.
+*/
+template<class Key, class Value, class Alloc>
+uint32_t OrderStatisticTree<Key, Value, Alloc>::recountSubtree(RankedAVLNode<Key, Value>* node)
+{
+    if(node == nullptr) {
+        return 0;
+    }
+    node->setCount(1 + recountSubtree(node->getLeft()) + recountSubtree(node->getRight()));
+    return node->getCount();
+}
+
+template<class Key, class Value, class Alloc>
+RankedAVLNode<Key, Value>* OrderStatisticTree<Key, Value, Alloc>::rankedRoot() const
+{
+    return static_cast<RankedAVLNode<Key, Value>*>(this->root_);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the OrderStatisticTree class.
+  ----------------------------------------------------
+*/
+
+#endif
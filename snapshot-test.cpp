@@ -0,0 +1,136 @@
+#include <iostream>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include "avlbst.h"
+#include "indexed_avl.h"
+#include "snapshot.h"
+
+using namespace std;
+
+// A key whose comparisons throw while refuseAt is one of the two keys
+struct FussyKey
+{
+    int key;
+    static int refuseAt;
+};
+int FussyKey::refuseAt = -1;
+
+int compare(const FussyKey& lhs, const FussyKey& rhs)
+{
+    if(lhs.key == FussyKey::refuseAt || rhs.key == FussyKey::refuseAt) {
+        throw runtime_error("refused to compare");
+    }
+    return (lhs.key > rhs.key) - (lhs.key < rhs.key);
+}
+
+bool operator<(const FussyKey& lhs, const FussyKey& rhs) { return compare(lhs, rhs) < 0; }
+bool operator>(const FussyKey& lhs, const FussyKey& rhs) { return compare(lhs, rhs) > 0; }
+bool operator==(const FussyKey& lhs, const FussyKey& rhs) { return compare(lhs, rhs) == 0; }
+
+
+int main(int argc, char *argv[])
+{
+    const char* path = "snapshot-test.bin";
+
+    AVLTree<int,double> at;
+    for(int i = 0; i < 100000; ++i) {
+        at.insert(std::make_pair((i * 7919) % 100003, i / 2.0));
+    }
+    saveSnapshot(at, path);
+
+    // Back into a tree, then into a different kind of tree
+    AVLTree<int,double> loaded;
+    loadSnapshot(loaded, path);
+    bool same = (loaded.size() == at.size());
+    AVLTree<int,double>::iterator lit = loaded.begin();
+    for(AVLTree<int,double>::iterator it = at.begin(); same && it != at.end(); ++it, ++lit) {
+        same = (lit->first == it->first && lit->second == it->second);
+    }
+    cout << "Loaded " << loaded.size() << " items, same as saved: " << same
+         << ", balanced: " << loaded.isBalanced() << endl;
+
+    IndexedAVLTree<int,double> it;
+    loadSnapshot(it, path);
+    cout << "IndexedAVLTree loaded " << it.size() << ", it[7919] = " << it[7919] << endl;
+
+    // Lookups straight from the file
+    {
+        MappedSnapshot<int,double> view(path);
+        bool found = true;
+        for(AVLTree<int,double>::iterator i = at.begin(); found && i != at.end(); ++i) {
+            MappedSnapshot<int,double>::iterator m = view.find(i->first);
+            found = (m != view.end() && m->second == i->second);
+        }
+        cout << "\nMapped view of " << view.size() << " items finds them all: " << found
+             << ", finds 100003: " << (view.find(100003) != view.end()) << endl;
+    }
+
+    // The wrong types, or a file that is not a snapshot, are errors
+    try {
+        MappedSnapshot<long,double> wrong(path);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    FILE* junk = fopen(path, "w");
+    fputs("not a tree", junk);
+    fclose(junk);
+    try {
+        loadSnapshot(loaded, path);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    remove(path);
+    try {
+        loadSnapshot(loaded, path);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    cout << "Tree unchanged by failed loads: " << (loaded.size() == at.size()) << endl;
+
+    // A load that fails part way through building the tree
+    AVLTree<FussyKey,int> fussy;
+    for(int i = 0; i < 1000; ++i) {
+        FussyKey key = { i };
+        fussy.insert(std::make_pair(key, i));
+    }
+    saveSnapshot(fussy, path);
+    AVLTree<FussyKey,int> fussyLoaded;
+    FussyKey first = { -1 };
+    fussyLoaded.insert(std::make_pair(first, 0));
+    FussyKey::refuseAt = 500;
+    try {
+        loadSnapshot(fussyLoaded, path);
+    }
+    catch(const runtime_error& e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    FussyKey::refuseAt = -1;
+    cout << "Tree unchanged by a load failing part way: "
+         << (fussyLoaded.size() == 1 && fussyLoaded.begin()->first.key == -1) << endl;
+
+    // Saves racing for the same path each write a file of their own
+    AVLTree<int,double> small;
+    small.insert(std::make_pair(1, 1.0));
+    std::thread racer([&]() {
+        for(int i = 0; i < 20; ++i) {
+            saveSnapshot(small, path);
+        }
+    });
+    for(int i = 0; i < 20; ++i) {
+        saveSnapshot(at, path);
+    }
+    racer.join();
+    loadSnapshot(loaded, path);
+    cout << "After racing saves the file holds one whole tree: "
+         << (loaded.size() == at.size() || loaded.size() == small.size()) << endl;
+
+    AVLTree<int,double> empty;
+    saveSnapshot(empty, path);
+    loadSnapshot(loaded, path);
+    cout << "Empty snapshot loads empty: " << loaded.empty() << endl;
+    remove(path);
+}
@@ -0,0 +1,571 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+* Binary snapshots of a map whose keys and values are trivially
+* copyable (ints, doubles, fixed-size structs; not std::string):
+*
+*   saveSnapshot(tree, path)   writes the tree's items to path
+*   loadSnapshot(tree, path)   replaces the tree's contents with them
+*   MappedSnapshot<K, V>(path) a read-only view of the file that answers
+*                              find() straight from the mapped pages
+*
+* The file is a SnapshotHeader followed by every key in increasing order,
+* then every value in the same order, each array starting on a cache
+* line. Numbers are in the writing machine's byte order; a file from a
+* machine of the other order, or written for other key or value sizes,
+* is rejected. Errors of any kind (I/O, a bad or truncated file) throw
+* std::runtime_error naming the file.
+*
+* Loading maps the file and feeds it to the sorted O(n) bulk load of
+* assign() on a new tree, which then replaces the old contents. It works
+* for AVLTree and its derived trees (through join()) and for
+* IndexedAVLTree (through swap()). Saving works for any map with
+* begin(), end() and size().
+*/
+
+struct SnapshotHeader
+{
+    char magic[8];              // "BSTSNAP" and a NUL
+    uint32_t version;
+    uint32_t byteOrder;         // SNAPSHOT_BYTE_ORDER as written by the saver
+    uint32_t keyBytes;          // sizeof(Key)
+    uint32_t valueBytes;        // sizeof(Value)
+    uint64_t count;
+    uint64_t keysOffset;        // from the start of the file
+    uint64_t valuesOffset;
+};
+
+static const char SNAPSHOT_MAGIC[8] = { 'B', 'S', 'T', 'S', 'N', 'A', 'P', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 1;
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304u;
+static const uint64_t SNAPSHOT_ALIGN = 64;
+
+inline uint64_t snapshotAlign(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+inline std::runtime_error snapshotError(const std::string& path, const std::string& what)
+{
+    return std::runtime_error("snapshot " + path + ": " + what);
+}
+
+/**
+* Throws unless header describes a well formed file of fileBytes bytes
+* holding Key/Value items.
+*/
+template<typename Key, typename Value>
+void checkSnapshotHeader(const SnapshotHeader& header, uint64_t fileBytes, const std::string& path)
+{
+    if(std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw snapshotError(path, "not a snapshot file");
+    }
+    if(header.version != SNAPSHOT_VERSION) {
+        throw snapshotError(path, "unsupported version " + std::to_string(header.version));
+    }
+    if(header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+        throw snapshotError(path, "written with a different byte order");
+    }
+    if(header.keyBytes != sizeof(Key) || header.valueBytes != sizeof(Value)) {
+        throw snapshotError(path, "written for " + std::to_string(header.keyBytes) + "-byte keys and " +
+                            std::to_string(header.valueBytes) + "-byte values");
+    }
+    if(header.keysOffset % SNAPSHOT_ALIGN != 0 || header.valuesOffset % SNAPSHOT_ALIGN != 0 ||
+       header.keysOffset < sizeof(SnapshotHeader) ||
+       header.keysOffset > fileBytes || header.valuesOffset > fileBytes ||
+       header.count > (fileBytes - header.keysOffset) / sizeof(Key) ||
+       header.count > (fileBytes - header.valuesOffset) / sizeof(Value)) {
+        throw snapshotError(path, "truncated or corrupt");
+    }
+}
+
+/**
+* Writes all of [data, data + bytes) at offset in fd, resuming after
+* short writes and signals.
+*/
+inline void writeSnapshotBytes(int fd, const void* data, std::size_t bytes, uint64_t offset,
+                               const std::string& path)
+{
+    const char* next = static_cast<const char*>(data);
+    while(bytes > 0) {
+        ssize_t done = ::pwrite(fd, next, bytes, static_cast<off_t>(offset));
+        if(done < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw snapshotError(path, std::strerror(errno));
+        }
+        next += done;
+        offset += static_cast<uint64_t>(done);
+        bytes -= static_cast<std::size_t>(done);
+    }
+}
+
+/**
+* Creates and opens a file named path plus a suffix that no other file
+* has, for writing. The suffix holds the process id and a count, and
+* O_EXCL makes sure that another writer's file is never reused.
+*/
+inline int createSnapshotTemp(const std::string& path, std::string& tempPath)
+{
+    static std::atomic<unsigned> counter(0);
+    for(;;) {
+        tempPath = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+        int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(fd >= 0) {
+            return fd;
+        }
+        if(errno != EEXIST && errno != EINTR) {
+            throw snapshotError(tempPath, std::strerror(errno));
+        }
+    }
+}
+
+/**
+* Flushes the directory holding path to disk, so that a rename into it
+* survives a crash.
+*/
+inline void syncSnapshotDirectory(const std::string& path)
+{
+    std::string::size_type slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw snapshotError(directory, std::strerror(errno));
+    }
+    int result = ::fsync(fd);
+    int error = errno;
+    ::close(fd);
+    if(result != 0) {
+        throw snapshotError(directory, std::strerror(error));
+    }
+}
+
+/**
+* Writes the items of tree to path. The file is written under a temporary
+* name of its own, flushed to disk, and renamed over path, after which
+* the directory is flushed as well. A crash at any point leaves either
+* the previous snapshot or the new one, and two saves to the same path
+* at once never write to the same file: the last rename wins.
+*/
+template<typename Tree>
+void saveSnapshot(const Tree& tree, const std::string& path)
+{
+    typedef typename std::decay<decltype(tree.begin()->first)>::type Key;
+    typedef typename std::decay<decltype(tree.begin()->second)>::type Value;
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "snapshots need trivially copyable keys and values");
+
+    // Items written per write() call
+    const std::size_t CHUNK = 4096;
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.keyBytes = sizeof(Key);
+    header.valueBytes = sizeof(Value);
+    header.count = tree.size();
+    header.keysOffset = snapshotAlign(sizeof(SnapshotHeader));
+    header.valuesOffset = snapshotAlign(header.keysOffset + header.count * sizeof(Key));
+
+    std::string tempPath;
+    int fd = createSnapshotTemp(path, tempPath);
+    try {
+        const char padding[SNAPSHOT_ALIGN] = { 0 };
+        writeSnapshotBytes(fd, &header, sizeof(header), 0, tempPath);
+        writeSnapshotBytes(fd, padding, header.keysOffset - sizeof(header), sizeof(header), tempPath);
+
+        // One pass over the tree: each chunk's keys and values are written
+        // at their places in the two arrays. The gap left between the
+        // arrays for alignment reads back as zeros.
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        keys.reserve(CHUNK);
+        values.reserve(CHUNK);
+        uint64_t written = 0;
+        auto it = tree.begin();
+        while(written < header.count) {
+            keys.clear();
+            values.clear();
+            for(; it != tree.end() && keys.size() < CHUNK; ++it) {
+                keys.push_back(it->first);
+                values.push_back(it->second);
+            }
+            if(keys.empty()) {
+                break;
+            }
+            writeSnapshotBytes(fd, keys.data(), keys.size() * sizeof(Key),
+                               header.keysOffset + written * sizeof(Key), tempPath);
+            writeSnapshotBytes(fd, values.data(), values.size() * sizeof(Value),
+                               header.valuesOffset + written * sizeof(Value), tempPath);
+            written += keys.size();
+        }
+        if(written != header.count) {
+            throw snapshotError(tempPath, "tree ended before size() items");
+        }
+        if(::fsync(fd) != 0) {
+            throw snapshotError(tempPath, std::strerror(errno));
+        }
+        int result = ::close(fd);
+        fd = -1;
+        if(result != 0) {
+            throw snapshotError(tempPath, std::strerror(errno));
+        }
+        if(std::rename(tempPath.c_str(), path.c_str()) != 0) {
+            throw snapshotError(path, std::strerror(errno));
+        }
+    }
+    catch(...) {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+        std::remove(tempPath.c_str());
+        throw;
+    }
+    syncSnapshotDirectory(path);
+}
+
+/**
+* A read-only view of a snapshot file, mapped into memory rather than
+* read: opening it costs a header check whatever the size, and pages are
+* only read from disk as lookups touch them. find() and lower_bound() are
+* a binary search over the mapped keys; iterators walk the items in key
+* order.
+*
+* The contents past the header are trusted: a file whose keys are not
+* sorted gives wrong answers rather than an error. The file must not be
+* modified in place while it is mapped; saveSnapshot() to the same path
+* is fine, since it replaces the file rather than rewriting it.
+*/
+template <typename Key, typename Value>
+class MappedSnapshot
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "snapshots need trivially copyable keys and values");
+
+public:
+    /**
+    * What an iterator dereferences to (see BTreeMap).
+    */
+    struct reference
+    {
+        const Key& first;
+        const Value& second;
+
+        reference(const Key& key, const Value& value) : first(key), second(value) {}
+        reference* operator->() { return this; }
+        operator std::pair<const Key, Value>() const { return std::pair<const Key, Value>(first, second); }
+    };
+
+    class iterator;
+
+    explicit MappedSnapshot(const std::string& path);
+    ~MappedSnapshot();
+
+    bool empty() const;
+    std::size_t size() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    Value const & operator[](const Key& key) const;
+
+protected:
+    std::size_t lowerBoundIndex(const Key& key) const;
+
+    void* map_;
+    std::size_t mapBytes_;
+    const Key* keys_;
+    const Value* values_;
+    std::size_t count_;
+
+private:
+    MappedSnapshot(const MappedSnapshot&);
+    MappedSnapshot& operator=(const MappedSnapshot&);
+
+public:
+    /**
+    * Forward iterator over the items in key order.
+    */
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename MappedSnapshot<Key, Value>::reference reference;
+        typedef reference pointer;
+
+        iterator();
+
+        reference operator*() const;
+        reference operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class MappedSnapshot<Key, Value>;
+        iterator(const MappedSnapshot<Key, Value>* owner, std::size_t index);
+        const MappedSnapshot<Key, Value>* owner_;
+        std::size_t index_;
+    };
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the MappedSnapshot::iterator class.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::iterator::iterator() :
+    owner_(nullptr),
+    index_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::iterator::iterator(const MappedSnapshot<Key, Value>* owner, std::size_t index) :
+    owner_(owner),
+    index_(index)
+{
+
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::reference
+MappedSnapshot<Key, Value>::iterator::operator*() const
+{
+    return reference(owner_->keys_[index_], owner_->values_[index_]);
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::reference
+MappedSnapshot<Key, Value>::iterator::operator->() const
+{
+    return **this;
+}
+
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator&
+MappedSnapshot<Key, Value>::iterator::operator++()
+{
+    ++index_;
+    return *this;
+}
+
+/*
+  ---------------------------------------------------------
+  End implementations for the MappedSnapshot::iterator class.
+  ---------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------
+  Begin implementations for the MappedSnapshot class.
+  ----------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::MappedSnapshot(const std::string& path) :
+    map_(nullptr),
+    mapBytes_(0),
+    keys_(nullptr),
+    values_(nullptr),
+    count_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw snapshotError(path, std::strerror(errno));
+    }
+    struct stat info;
+    if(::fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw snapshotError(path, std::strerror(error));
+    }
+    if(static_cast<uint64_t>(info.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw snapshotError(path, "truncated or corrupt");
+    }
+    mapBytes_ = static_cast<std::size_t>(info.st_size);
+    void* map = ::mmap(nullptr, mapBytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if(map == MAP_FAILED) {
+        throw snapshotError(path, std::strerror(error));
+    }
+    map_ = map;
+
+    try {
+        const SnapshotHeader& header = *static_cast<const SnapshotHeader*>(map_);
+        checkSnapshotHeader<Key, Value>(header, mapBytes_, path);
+        keys_ = reinterpret_cast<const Key*>(static_cast<const char*>(map_) + header.keysOffset);
+        values_ = reinterpret_cast<const Value*>(static_cast<const char*>(map_) + header.valuesOffset);
+        count_ = static_cast<std::size_t>(header.count);
+    }
+    catch(...) {
+        ::munmap(map_, mapBytes_);
+        throw;
+    }
+}
+
+template<typename Key, typename Value>
+MappedSnapshot<Key, Value>::~MappedSnapshot()
+{
+    ::munmap(map_, mapBytes_);
+}
+
+template<typename Key, typename Value>
+bool MappedSnapshot<Key, Value>::empty() const
+{
+    return count_ == 0;
+}
+
+template<typename Key, typename Value>
+std::size_t MappedSnapshot<Key, Value>::size() const
+{
+    return count_;
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator
+MappedSnapshot<Key, Value>::begin() const
+{
+    return iterator(this, 0);
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator
+MappedSnapshot<Key, Value>::end() const
+{
+    return iterator(this, count_);
+}
+
+/**
+* Index of the first key not less than key. Halves the range with a
+* conditional move rather than a branch, as KeySearch does within a
+* BTreeMap node.
+*/
+template<typename Key, typename Value>
+std::size_t MappedSnapshot<Key, Value>::lowerBoundIndex(const Key& key) const
+{
+    if(count_ == 0) {
+        return 0;
+    }
+    const Key* base = keys_;
+    std::size_t len = count_;
+    while(len > 1) {
+        std::size_t half = len / 2;
+        base = (base[half - 1] < key) ? base + half : base;
+        len -= half;
+    }
+    return static_cast<std::size_t>(base - keys_) + (*base < key);
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator
+MappedSnapshot<Key, Value>::lower_bound(const Key& key) const
+{
+    return iterator(this, lowerBoundIndex(key));
+}
+
+template<typename Key, typename Value>
+typename MappedSnapshot<Key, Value>::iterator
+MappedSnapshot<Key, Value>::find(const Key& key) const
+{
+    std::size_t index = lowerBoundIndex(key);
+    if(index == count_ || key < keys_[index]) {
+        return end();
+    }
+    return iterator(this, index);
+}
+
+/**
+* @precondition The key exists in the snapshot
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value>
+Value const & MappedSnapshot<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+  --------------------------------------------------
+  End implementations for the MappedSnapshot class.
+  --------------------------------------------------
+*/
+
+// Moves the contents of loaded into tree, which is empty: by swap() where
+// the tree has one, else by join() (AVLTree and its derived trees)
+template<typename Tree>
+auto adoptSnapshot(Tree& tree, Tree& loaded, int) -> decltype(tree.swap(loaded))
+{
+    tree.swap(loaded);
+}
+
+template<typename Tree>
+void adoptSnapshot(Tree& tree, Tree& loaded, long)
+{
+    tree.join(loaded);
+}
+
+/**
+* Replaces the contents of tree with the items saved in path. The items
+* are loaded into a new tree that then takes the place of tree's, so if
+* loading throws, tree is left as it was.
+*/
+template<typename Tree>
+void loadSnapshot(Tree& tree, const std::string& path)
+{
+    typedef typename std::decay<decltype(tree.begin()->first)>::type Key;
+    typedef typename std::decay<decltype(tree.begin()->second)>::type Value;
+
+    MappedSnapshot<Key, Value> snapshot(path);
+    Tree loaded;
+    loaded.assign(snapshot.begin(), snapshot.end());
+    tree.clear();
+    adoptSnapshot(tree, loaded, 0);
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef STREAM_LOADER_H
+#define STREAM_LOADER_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* What loadStream() did: how many records it read, how many batches took
+* the sorted path and how many the insert path, and how long it took.
+*/
+struct LoadStats
+{
+    LoadStats() : records(0), sortedBatches(0), insertedBatches(0), seconds(0.0) {}
+
+    double recordsPerSecond() const
+    {
+        return (seconds > 0.0) ? records / seconds : 0.0;
+    }
+
+    void print(std::ostream& out) const
+    {
+        out << records << " records in " << seconds << "s (" << recordsPerSecond() << " records/s), "
+            << sortedBatches << " sorted batches, " << insertedBatches << " inserted batches" << std::endl;
+    }
+
+    std::size_t records;
+    std::size_t sortedBatches;      // bulk loaded and joined on
+    std::size_t insertedBatches;    // through insert_batch()
+    double seconds;
+};
+
+// Records buffered at a time by loadStream()
+static const std::size_t STREAM_BATCH = 65536;
+
+/**
+* Adds the records of in to tree, an AVLTree or a tree derived from it,
+* as if each were insert()ed in turn (a later record for a key
+* overwrites an earlier one). A record is a key then a value, read with
+* operator>> and separated by whitespace, such as lines of "key value".
+*
+* At most batchSize records are held at once. A batch whose keys are
+* strictly increasing and all greater than the tree's, as every batch of
+* a sorted file is, is bulk loaded in O(batchSize) and joined onto the
+* tree in O(log n), so a sorted file loads in linear time. The batch is
+* built as a Tree of its own, so that a derived tree's extra per-node
+* data is right before the join. Any other batch goes through
+* insert_batch(), which sorts it and merges it in.
+*
+* A record that does not parse throws std::runtime_error giving its
+* number; the records before it have been loaded.
+*/
+template<class Tree>
+LoadStats loadStream(Tree& tree, std::istream& in, std::size_t batchSize = STREAM_BATCH)
+{
+    typedef typename Tree::iterator::value_type Item;
+    typedef typename std::remove_const<typename Item::first_type>::type Key;
+    typedef typename Item::second_type Value;
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+
+    if(batchSize == 0) {
+        batchSize = 1;
+    }
+    LoadStats stats;
+    std::vector<std::pair<Key, Value> > batch;
+    batch.reserve(batchSize);
+    std::string error;
+    bool done = false;
+    while(!done) {
+        batch.clear();
+        Key key;
+        Value value;
+        while(batch.size() < batchSize && in >> key) {
+            if(!(in >> value)) {
+                error = "missing or malformed value";
+                break;
+            }
+            batch.push_back(std::make_pair(key, value));
+        }
+        if(batch.size() < batchSize) {
+            if(error.empty() && !in.eof()) {
+                error = "malformed key";
+            }
+            done = true;
+        }
+        if(batch.empty()) {
+            break;
+        }
+
+        bool sorted = tree.empty() || tree.rbegin()->first < batch.front().first;
+        for(std::size_t i = 1; sorted && i < batch.size(); ++i) {
+            sorted = batch[i - 1].first < batch[i].first;
+        }
+        if(sorted) {
+            Tree upper(batch.begin(), batch.end());
+            tree.join(upper);
+            ++stats.sortedBatches;
+        }
+        else {
+            tree.insert_batch(batch.begin(), batch.end());
+            ++stats.insertedBatches;
+        }
+        stats.records += batch.size();
+    }
+    if(!error.empty()) {
+        throw std::runtime_error("record " + std::to_string(stats.records + 1) + ": " + error);
+    }
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return stats;
+}
+
+/**
+* loadStream() from the file at path. Throws std::runtime_error if it
+* cannot be opened.
+*/
+template<class Tree>
+LoadStats loadFile(Tree& tree, const std::string& path, std::size_t batchSize = STREAM_BATCH)
+{
+    std::ifstream in(path.c_str());
+    if(!in) {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+    return loadStream(tree, in, batchSize);
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+/**
+* Stats policies for BinarySearchTree and AVLTree, chosen by their last
+* template parameter. The trees call a hook on the policy at each event
+* worth counting:
+*
+*   compared(n)        n key comparisons (calls of ==, < and >) made by
+*                      internalFind (find, operator[], remove, ...),
+*                      each counted where it is made
+*   descended(depth)   an internalFind descent visited depth nodes
+*   rotatedLeft()      one rotateLeft or rotateRight
+*   rotatedRight()
+*   insertFixLevel()   insertFix or removeFix moved up one level
+*   removeFixLevel()
+*   swappedNodes()     one nodeSwap
+*
+* NoTreeStats, the default, has empty inline hooks, so a tree built with
+* it compiles to exactly the code it had before. TreeStats counts; read
+* its fields directly, or dump() them for a metrics pipeline:
+*
+*   AVLTree<int, int, NodePool<AVLNode<int, int> >, TreeStats> tree;
+*   ...
+*   tree.stats().dump(std::cout, "orders");
+*
+* A tree's counters are plain integers updated by const lookups too, so
+* a tree that counts must not be read from several threads at once. For
+* the same reason its merge, intersect, difference and insert_batch
+* rebalance on the calling thread only, whatever thread count is asked.
+*/
+class NoTreeStats
+{
+public:
+    void compared(unsigned) {}
+    void descended(std::size_t) {}
+    void rotatedLeft() {}
+    void rotatedRight() {}
+    void insertFixLevel() {}
+    void removeFixLevel() {}
+    void swappedNodes() {}
+};
+
+class TreeStats
+{
+public:
+    // Descents of this depth or more share the last histogram bucket
+    static const std::size_t MAX_DEPTH = 64;
+
+    TreeStats();
+
+    void compared(unsigned n);
+    void descended(std::size_t depth);
+    void rotatedLeft();
+    void rotatedRight();
+    void insertFixLevel();
+    void removeFixLevel();
+    void swappedNodes();
+
+    void reset();
+    void dump(std::ostream& out, const std::string& prefix = "tree") const;
+
+    uint64_t comparisons;
+    uint64_t descents;
+    uint64_t depthCounts[MAX_DEPTH];  // depthCounts[d]: descents that visited d nodes
+    uint64_t leftRotations;
+    uint64_t rightRotations;
+    uint64_t insertFixLevels;
+    uint64_t removeFixLevels;
+    uint64_t nodeSwaps;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the TreeStats class.
+  -----------------------------------------------
+*/
+
+inline TreeStats::TreeStats()
+{
+    reset();
+}
+
+inline void TreeStats::compared(unsigned n)
+{
+    comparisons += n;
+}
+
+inline void TreeStats::descended(std::size_t depth)
+{
+    ++descents;
+    ++depthCounts[depth < MAX_DEPTH ? depth : MAX_DEPTH - 1];
+}
+
+inline void TreeStats::rotatedLeft()
+{
+    ++leftRotations;
+}
+
+inline void TreeStats::rotatedRight()
+{
+    ++rightRotations;
+}
+
+inline void TreeStats::insertFixLevel()
+{
+    ++insertFixLevels;
+}
+
+inline void TreeStats::removeFixLevel()
+{
+    ++removeFixLevels;
+}
+
+inline void TreeStats::swappedNodes()
+{
+    ++nodeSwaps;
+}
+
+inline void TreeStats::reset()
+{
+    comparisons = 0;
+    descents = 0;
+    for(std::size_t d = 0; d < MAX_DEPTH; ++d) {
+        depthCounts[d] = 0;
+    }
+    leftRotations = 0;
+    rightRotations = 0;
+    insertFixLevels = 0;
+    removeFixLevels = 0;
+    nodeSwaps = 0;
+}
+
+/**
+* Writes one "<prefix>.<counter> <value>" line per counter, and one
+* "<prefix>.depth.<d> <count>" line per non-empty histogram bucket.
+*/
+inline void TreeStats::dump(std::ostream& out, const std::string& prefix) const
+{
+    out << prefix << ".comparisons " << comparisons << "\n"
+        << prefix << ".descents " << descents << "\n"
+        << prefix << ".rotations.left " << leftRotations << "\n"
+        << prefix << ".rotations.right " << rightRotations << "\n"
+        << prefix << ".insert_fix_levels " << insertFixLevels << "\n"
+        << prefix << ".remove_fix_levels " << removeFixLevels << "\n"
+        << prefix << ".node_swaps " << nodeSwaps << "\n";
+    for(std::size_t d = 0; d < MAX_DEPTH; ++d) {
+        if(depthCounts[d] != 0) {
+            out << prefix << ".depth." << d << " " << depthCounts[d] << "\n";
+        }
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the TreeStats class.
+  ---------------------------------------------
+*/
+
+#endif